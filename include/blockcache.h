@@ -0,0 +1,111 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+#include "bus.h"
+
+struct DecodedInstruction{
+    uint8_t opcode;
+    uint8_t operands[2]; // immediate bytes after the opcode, for 0xCB the first one is the CB opcode
+    uint8_t length; // total bytes including the opcode
+    uint8_t cycles; // M cycles, conditional branches store their not taken cost
+};
+
+struct BasicBlock{
+    static constexpr int MAX_INSTRUCTIONS = 32;
+
+    uint16_t startPC = 0;
+    uint16_t bank = 0;
+    uint8_t count = 0; // 0 when the code at startPC cant be cached
+    uint16_t cycles = 0; // cost of running the whole block straight through
+    uint32_t executions = 0; // times the block was entered from the top, used to find hot code
+    uintptr_t compiled = 0; // entry point of native code for the block, 0 when not compiled
+    DecodedInstruction instructions[MAX_INSTRUCTIONS];
+};
+
+/**
+ * Caches straight line runs of ROM code keyed by PC and the bank mapped there, so the
+ * interpreter can skip Bus::read for opcode and operand fetches
+ */
+class BlockCache{
+public:
+    BlockCache(Bus& bus);
+
+    /**
+     * Gets the decoded instruction at pc. Carries on through the current block while execution
+     * is straight line, otherwise looks up or decodes the block starting at pc
+     *
+     * @param pc address of the next instruction
+     * @return decoded instruction or nullptr when pc isnt cacheable (code in RAM, OAM DMA running)
+     */
+    const DecodedInstruction* fetch(uint16_t pc){
+        // OAM DMA blocks the cpu from reading ROM, only the bus knows how to handle that
+        if(bus.ppu.isOamDmaActive()){
+            current = nullptr;
+            return nullptr;
+        }
+
+        if(!continues(pc) && !enter(pc)){
+            return nullptr;
+        }
+
+        const DecodedInstruction& instruction = current->instructions[cursor++];
+        nextPC = uint16_t(pc + instruction.length);
+        return &instruction;
+    }
+
+    /**
+     * Whether pc is the next instruction of the block currently being executed
+     */
+    bool continues(uint16_t pc) const{
+        return current && pc == nextPC && cursor < current->count && mappedSwitchCount == bus.bankSwitchCount();
+    }
+
+    /**
+     * Makes the block starting at pc current, decoding it on first use
+     *
+     * @param pc address of the first instruction
+     * @return the block or nullptr when pc isnt cacheable
+     */
+    BasicBlock* enter(uint16_t pc);
+
+    /**
+     * Forgets the current block, for when something else ran it to completion
+     */
+    void leave(){
+        current = nullptr;
+    }
+
+    /**
+     * Drops every decoded block
+     */
+    void clear();
+
+    uint64_t getBlocksDecoded() const{
+        return blocksDecoded;
+    }
+private:
+    Bus& bus;
+
+    std::deque<BasicBlock> blocks; // deque so references stay valid as blocks are added
+    std::vector<std::unique_ptr<BasicBlock*[]>> bankIndex; // per bank, 0x4000 block pointers, nullptr = not decoded yet
+
+    // index of the bank mapped at 0x0000-0x3FFF and 0x4000-0x7FFF, as of mappedSwitchCount
+    BasicBlock** regions[2] = {};
+    uint32_t mappedSwitchCount = 0;
+
+    // looks up the banks mapped now, only needed after a bank switch
+    void mapRegions();
+
+    const BasicBlock* current = nullptr;
+    uint8_t cursor = 0; // next instruction in current
+    uint16_t nextPC = 0; // address that instruction lives at
+    uint64_t blocksDecoded = 0;
+
+    /**
+     * Decodes from pc up to the first control flow instruction, the end of the 16KiB ROM
+     * region or MAX_INSTRUCTIONS, whichever comes first
+     */
+    BasicBlock& decode(uint16_t pc, uint16_t bank);
+};
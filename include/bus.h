@@ -4,20 +4,26 @@
 #include "cartridge.h"
 #include "timer.h"
 #include "ppu.h"
-
-class CPU;
+#include "io.h"
+#include "joypad.h"
+#include "interrupts.h"
+#include "scheduler.h"
 
 class Bus{
 public:
     Bus(Cartridge& cart);
 
     /**
-     * Reads a 16 bit address passing the handling of the memory retrieval to whatever section the memory points to
+     * Reads a 16 bit address passing the handling of the memory retrieval to whatever section the memory points to.
+     * Pages backed by plain memory are read straight through the memory map
      * 
      * @param address 16 bit address to read from
      * @return byte stored at that address
      */
-    uint8_t read(uint16_t address);
+    uint8_t read(uint16_t address){
+        if(const uint8_t* page = map->read[address >> 8]) return page[address & 0xFF];
+        return readSlow(address);
+    }
     /**
      * Same as read except there is no guard for dma
      */
@@ -29,36 +35,112 @@ public:
      * @param address 16 bit address to write to
      * @param byte the byte to write to that address
      */
-    void write(uint16_t address, uint8_t byte);
+    void write(uint16_t address, uint8_t byte){
+        writeCount++;
+        if(uint8_t* page = map->write[address >> 8]){
+            page[address & 0xFF] = byte;
+            return;
+        }
+        writeSlow(address, byte);
+    }
     /**
-     * advances all peripherals by tStates
+     * Advances the clock by tStates and runs every peripheral event that came due, peripherals
+     * with nothing due catch up on their own when next accessed
      * 
      * @param tStates number of t states = 4xM-cycles
-     * @param cpu reference to cpu
      */
-    void step(int tStates, CPU& cpu);
+    void step(int tStates){
+        scheduler.advance(tStates);
+        if(scheduler.isDue()) runEvents();
+    }
     /**
      * Sets the state for the joyp register to emulate key presses
      * 
      * @param keyState array containing bools pressed/not pressed for each key
      */
     void setKeyState(const bool keyState[8]);
+    /**
+     * M cycles until the next scheduled event, passing this many cycles to step in one go is the
+     * same as passing them one at a time when the cpu isnt doing anything in between
+     * 
+     * @return M cycles until the next event, at least 1
+     */
+    int cyclesUntilNextEvent() const;
+    /**
+     * M cycles until anything the cpu can read might change. Like cyclesUntilNextEvent() but also
+     * stops at PPU mode changes, which only get an event when they raise an interrupt
+     * 
+     * @return M cycles until the next event or PPU mode change, at least 1
+     */
+    int cyclesUntilStateChange();
+    /**
+     * ROM bank currently mapped at a 0x0000-0x7FFF address
+     * 
+     * @param address 16 bit ROM address
+     * @return bank number backing that address
+     */
+    uint16_t romBankAt(uint16_t address) const{
+        return cart.romBankAt(address);
+    }
+    /**
+     * Number of cartridge banking register writes so far, changes whenever the ROM mapping may have
+     */
+    uint32_t bankSwitchCount() const{
+        return cart.getBankSwitchCount();
+    }
+    /**
+     * Total t states passed to step so far
+     */
+    uint64_t getElapsed() const{
+        return scheduler.getNow();
+    }
+    /**
+     * Number of writes made through write so far, used to spot code that has no side effects
+     */
+    uint32_t getWriteCount() const{
+        return writeCount;
+    }
+    /**
+     * Number of reads of the timer registers so far, they change without the timer raising an event
+     */
+    uint32_t getTimerReadCount() const{
+        return timer.getReadCount();
+    }
+    Scheduler scheduler;
     PPU ppu;
+    InterruptController interrupts;
 private:
     Cartridge& cart;
     Timer timer;
+    Joypad joypad;
+    IO io; // FF00-FF7F, the peripherals above attach their registers to it
+
+    // one entry per 256 byte page, nullptr sends the access down the slow path
+    struct MemoryMap{
+        const uint8_t* read[256]{};
+        uint8_t* write[256]{};
+    };
+
+    MemoryMap memoryMap; // ROM, cartridge RAM and WRAM pages
+    MemoryMap dmaMap; // empty, swapped in while OAM DMA leaves only HRAM readable
+    const MemoryMap* map = &memoryMap;
+
+    /**
+     * Points the ROM and cartridge RAM pages at whatever the MBC has mapped there, called after
+     * every write to the MBC registers
+     */
+    void mapCartridge();
+
+    // dispatches due events to whichever peripheral scheduled them
+    void runEvents();
+
+    uint8_t readSlow(uint16_t address);
+    void writeSlow(uint16_t address, uint8_t byte);
 
     // 8 KiB work ram
     uint8_t wram[0x2000];
     // High ram (127 bytes)
     uint8_t hram[0x7F];
-    // IO registers
-    uint8_t ioRegs[0x80];
-    // Interrupt enable
-    uint8_t ieReg = 0;
-    uint8_t interruptFlag = 0xE1;
 
-    // joyp register state for 0xFF00
-    uint8_t joyp = 0xCF;
-    bool keys[8]{}; // current key states. true = pressed
+    uint32_t writeCount = 0;
 };
\ No newline at end of file
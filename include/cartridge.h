@@ -63,6 +63,37 @@ public:
      * @return true if successfully written, false if not
      */
     bool writeByte(uint16_t address, uint8_t byte);
+
+    /**
+     * Which ROM bank is currently mapped at an address in 0x0000-0x7FFF
+     * 
+     * @param address 16 bit ROM address
+     * @return bank number backing that address
+     */
+    uint16_t romBankAt(uint16_t address) const;
+
+    /**
+     * Where the ROM bank mapped at an address lives, lets the bus read ROM without going through readByte
+     * 
+     * @param address 16 bit ROM address
+     * @return start of that 16KiB bank, nullptr if the bank is past the end of the ROM
+     */
+    const uint8_t* romBankData(uint16_t address) const;
+
+    /**
+     * Where the RAM bank mapped at 0xA000-0xBFFF lives, for plain reads and writes that skip readByte/writeByte
+     * 
+     * @return start of that 8KiB bank, nullptr when RAM is disabled, missing or needs readByte/writeByte (MBC2, RTC)
+     */
+    uint8_t* ramBankData();
+
+    /**
+     * Counts writes to the banking registers, lets callers that cache ROM contents
+     * notice the mapping may have changed
+     */
+    uint32_t getBankSwitchCount() const{
+        return bankSwitchCount;
+    }
 private:
     CartHeader header;
     std::string romPath;
@@ -80,6 +111,7 @@ private:
     uint8_t mbc3RamBank = 0;      // 0-3 when RAM selected
     bool    mbc3RamRtcEnable = false;
     uint8_t mbc3RtcSel = 0xFF; 
+    uint32_t bankSwitchCount = 0;
 
     size_t romBankCount() const { return romData.size() / 0x4000; }
 
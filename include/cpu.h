@@ -1,5 +1,9 @@
 #pragma once
 #include "bus.h"
+#include "blockcache.h"
+#include "jit.h"
+
+class TraceBuffer;
 
 class CPU{
 public:
@@ -12,16 +16,112 @@ public:
 
     /**
      * Steps through opcodes, fetching decoding and executing returning the amount
-     * of machine cycles the step took
+     * of machine cycles the step took. A compiled JIT block runs several instructions in one
+     * step and passes all but the last one's cycles to Bus::step itself
      * 
-     * @return number of M cycles
+     * @return number of M cycles still to be passed to Bus::step
      */
     int step();
+
+    /**
+     * Runs instructions back to back for at least cycles M cycles, passing each one's cycles to
+     * Bus::step. That only advances the clock until a peripheral event is due, the timer and PPU
+     * otherwise catch up when an instruction touches their memory or registers
+     * 
+     * @param cycles M cycles to run for
+     * @return M cycles actually run, the last instruction can go past cycles
+     */
+    int runFor(int cycles);
+
+    /**
+     * Same as runFor() but runs until the PPU has finished a frame
+     */
+    void runUntilFrame();
     
     Bus& bus;
 
-    // regs
-    uint8_t A, F;
+    // opcode dispatch backends, SWITCH is the reference switch in instructions.h
+    enum class Backend : uint8_t {
+        SWITCH,
+        TABLE, // 256 entry handler tables from dispatch.h
+        BLOCK_CACHE, // TABLE fed from pre-decoded ROM blocks, no faster than TABLE as ROM reads are already one page lookup
+        JIT // BLOCK_CACHE with hot blocks compiled to native code, where the host supports it
+    };
+
+    Backend backend = Backend::TABLE;
+    BlockCache blockCache;
+    Jit jit;
+
+    /**
+     * Fetches the next instruction byte at PC, from the pre-decoded operands when the current
+     * instruction came out of the block cache, otherwise through the bus
+     * 
+     * @return byte at PC before it was incremented
+     */
+    uint8_t fetch(){
+        if(operands){
+            if(accurateTiming) instructionCycles++;
+            PC++;
+            return *operands++;
+        }
+        return read(PC++);
+    }
+
+    // when set every memory access lands on its own M cycle, see read()
+    bool accurateTiming = false;
+
+    /**
+     * Memory read for instruction handlers. In accurate mode the read happens on the next M cycle
+     * of the instruction, so the clock is moved up to that cycle first and the timer and PPU see
+     * the access when it really happens
+     * 
+     * @param address 16 bit address to read from
+     * @return byte stored at that address
+     */
+    uint8_t read(uint16_t address){
+        if(accurateTiming) accessCycle();
+        return bus.read(address);
+    }
+
+    /**
+     * Memory write for instruction handlers, timed the same way as read()
+     * 
+     * @param address 16 bit address to write to
+     * @param byte the byte to write to that address
+     */
+    void write(uint16_t address, uint8_t byte){
+        if(accurateTiming) accessCycle();
+        bus.write(address, byte);
+    }
+
+    /**
+     * An M cycle where the instruction doesnt touch memory, only matters when it comes before an access
+     */
+    void internalCycle(){
+        if(accurateTiming) instructionCycles++;
+    }
+
+    /**
+     * Resets the per instruction cycle count, called before running an opcode handler
+     */
+    void beginInstruction(){
+        instructionCycles = 0;
+        syncedCycles = 0;
+    }
+
+    /**
+     * @param cycles M cycles the opcode handler returned
+     * @return the ones the bus hasnt already been caught up on
+     */
+    int endInstruction(int cycles){
+        int remaining = cycles - syncedCycles;
+        instructionCycles = 0;
+        syncedCycles = 0;
+        return remaining;
+    }
+
+    // regs, F lives in the private section as it is evaluated lazily
+    uint8_t A;
     uint8_t B, C;
     uint8_t D, E;
     uint8_t H, L;
@@ -29,11 +129,12 @@ public:
     uint16_t PC;
 
     uint16_t AF() const{
-        return (uint16_t(A) << 8) | F;
+        return (uint16_t(A) << 8) | flags();
     }
     void AF(uint16_t val){
         A = val >> 8;
         F = val & 0xF0; // 0xF0 as only the upper 4 bits of F are valid flags
+        flagOp = FlagOp::NONE;
     }
 
     uint16_t BC() const{
@@ -66,7 +167,35 @@ public:
     static constexpr uint8_t hF = 0x20; // half carry flag, 0x20 isolates bit 5
     static constexpr uint8_t cF = 0x10; // carry flag, 0x10 isolates bit 4
 
+    // 8 bit ALU ops whose flags are worked out from their operands only when F is read
+    enum class FlagOp : uint8_t {
+        NONE, // F is up to date
+        ADD, ADC, SUB, SBC, // lhs = A before the op, rhs = operand, carry = carry in
+        LOGIC, // AND/OR/XOR, lhs = result, rhs = 0x20 for AND (sets H) else 0
+        INC, DEC // lhs = value before the op, carry = C before the op (unchanged by INC/DEC)
+    };
+
+    /**
+     * Records an ALU op instead of updating F, the flags are produced by flags() when something
+     * actually reads them (conditional jumps, PUSH AF, DAA, ADC/SBC, anything using setFlag)
+     */
+    void deferFlags(FlagOp op, uint8_t lhs, uint8_t rhs = 0, uint8_t carry = 0){
+        flagOp = op;
+        flagLhs = lhs;
+        flagRhs = rhs;
+        flagCarry = carry;
+    }
+
+    /**
+     * Current value of F, evaluating a deferred ALU op if there is one
+     */
+    uint8_t flags() const{
+        return flagOp == FlagOp::NONE ? F : evaluateFlags();
+    }
+
     void setFlag(uint8_t isolatingBit, bool on){
+        F = flags();
+        flagOp = FlagOp::NONE;
         if(on){
             F |= isolatingBit;
         }else{
@@ -74,12 +203,41 @@ public:
         }
     }
 
+    // overwrites all four flags at once, skipping the evaluation of any deferred op
+    void setFlags(bool z, bool n, bool h, bool c){
+        F = (z ? zF : 0) | (n ? nF : 0) | (h ? hF : 0) | (c ? cF : 0);
+        flagOp = FlagOp::NONE;
+    }
+
     bool getFlag(uint8_t isolatingBit) const{
-        return (F & isolatingBit) != 0; // if flag bit is 0, expression == 0, so false, else true
+        return (flags() & isolatingBit) != 0; // if flag bit is 0, expression == 0, so false, else true
     }
 
+    // carry flag on its own, cheaper than flags() when an op is deferred
+    bool carryFlag() const{
+        switch(flagOp){
+            case FlagOp::ADD:
+            case FlagOp::ADC: return flagLhs + flagRhs + flagCarry > 0xFF;
+            case FlagOp::SUB:
+            case FlagOp::SBC: return flagLhs < flagRhs + flagCarry;
+            case FlagOp::LOGIC: return false;
+            case FlagOp::INC:
+            case FlagOp::DEC: return flagCarry != 0;
+            default: return (F & cF) != 0;
+        }
+    }
+
+    const uint8_t* operands = nullptr; // operands of the decoded instruction being executed
+
     bool halted = false;
     bool stopped = false;
+
+    // every instruction is recorded here when set, the JIT is bypassed so nothing is missed
+    TraceBuffer* trace = nullptr;
+
+    // skip iterations of loops that just poll memory until something changes it
+    bool idleLoopSkipping = true;
+    uint64_t idleCyclesSkipped = 0; // M cycles skipped so far, never reset
     
     // Interupts
     enum Interrupt : uint8_t {
@@ -103,4 +261,112 @@ public:
      * @param interruptSource the thing requesting the interupt
      */
     void requestInterrupt(Interrupt interruptSource);
+private:
+    friend class Jit; // compiled blocks address the lazy flag fields directly
+
+    // state at the head of the last backward jump taken, compared on the next one to find idle loops
+    struct IdleLoop{
+        uint16_t head = 0;
+        uint16_t branch = 0; // address of the instruction (or compiled block) that jumped back
+        uint16_t registers[5]{}; // AF, BC, DE, HL, SP
+        bool IME = false;
+        bool imeEnabledNextStep = false;
+        uint32_t writeCount = 0;
+        uint32_t timerReadCount = 0;
+        uint64_t elapsed = 0;
+        uint64_t quietUntil = 0; // last t state before the next timer or PPU event
+    };
+
+    // accurate timing, M cycles since the opcode fetch and how many of them the bus has seen
+    int instructionCycles = 0;
+    int syncedCycles = 0;
+
+    void accessCycle(){
+        // only moving the clock is cheap, peripherals catch up themselves if the access is theirs
+        if(instructionCycles != syncedCycles){
+            bus.step((instructionCycles - syncedCycles) * 4);
+            syncedCycles = instructionCycles;
+        }
+        instructionCycles++;
+    }
+
+    /**
+     * Shared loop behind runFor() and runUntilFrame()
+     * 
+     * @param cycles M cycles to run for
+     * @param untilFrame also stop once the PPU has a finished frame
+     * @return M cycles actually run
+     */
+    int run(int cycles, bool untilFrame);
+
+    IdleLoop idleLoop;
+    uint16_t lastPC = 0; // PC at the start of the previous step
+
+    // loops longer than this arent looked at
+    static constexpr uint16_t IDLE_LOOP_MAX_BYTES = 32;
+
+    /**
+     * Called when PC has jumped back to at most IDLE_LOOP_MAX_BYTES before branch. If the last
+     * iteration of this loop started from the exact same registers, wrote nothing and finished
+     * before any timer or PPU event, it only depends on memory it reads, which cant change before
+     * the next event either, so every whole iteration that fits before that event is skipped
+     *
+     * @param branch address of the instruction that jumped back to PC
+     * @return M cycles skipped, 0 if the loop isnt idle or no whole iteration fits
+     */
+    int skipIdleLoop(uint16_t branch);
+
+    /**
+     * Records the instruction about to run into trace
+     * 
+     * @param pc address of the opcode
+     * @param opcode the opcode
+     * @param operands its pre-decoded operand bytes, nullptr to read them from memory
+     */
+    void traceInstruction(uint16_t pc, uint8_t opcode, const uint8_t* operands);
+
+    /**
+     * Records cycles the cpu fast forwards over into trace, so its timestamps account for them
+     *
+     * @param cycles M cycles skipped from now
+     * @return cycles, to return straight from step()
+     */
+    int traceSkip(int cycles);
+
+    uint8_t F; // flags, stale while flagOp != NONE so always read through flags()/getFlag()/AF()
+
+    FlagOp flagOp = FlagOp::NONE;
+    uint8_t flagLhs = 0;
+    uint8_t flagRhs = 0;
+    uint8_t flagCarry = 0;
+
+    uint8_t evaluateFlags() const{
+        uint8_t lhs = flagLhs, rhs = flagRhs, carry = flagCarry;
+        switch(flagOp){
+            case FlagOp::ADD:
+            case FlagOp::ADC: {
+                uint16_t result = lhs + rhs + carry;
+                return ((result & 0xFF) == 0 ? zF : 0)
+                     | (((lhs & 0x0F) + (rhs & 0x0F) + carry) > 0x0F ? hF : 0)
+                     | (result > 0xFF ? cF : 0);
+            }
+            case FlagOp::SUB:
+            case FlagOp::SBC:
+                return (uint8_t(lhs - rhs - carry) == 0 ? zF : 0) | nF
+                     | ((lhs & 0x0F) < ((rhs & 0x0F) + carry) ? hF : 0)
+                     | (lhs < (rhs + carry) ? cF : 0);
+            case FlagOp::LOGIC:
+                return (lhs == 0 ? zF : 0) | rhs;
+            case FlagOp::INC:
+                return (uint8_t(lhs + 1) == 0 ? zF : 0)
+                     | ((lhs & 0x0F) == 0x0F ? hF : 0)
+                     | (carry ? cF : 0);
+            case FlagOp::DEC:
+                return (uint8_t(lhs - 1) == 0 ? zF : 0) | nF
+                     | ((lhs & 0x0F) == 0x00 ? hF : 0)
+                     | (carry ? cF : 0);
+            default:
+                return F;
+        }
+    }
 };
\ No newline at end of file
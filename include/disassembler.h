@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+/**
+ * Turns one instruction into text using the mnemonics in opcodes.h, immediates are printed
+ * in hex and relative jumps as their target address
+ * 
+ * @param bytes the opcode followed by as many operand bytes as it has (OPCODES[opcode].length - 1)
+ * @param address where the instruction lives, needed to resolve relative jumps
+ * @return assembly text, e.g. "LDH A, ($FF44)" or "JR NZ, $0233"
+ */
+std::string disassemble(const uint8_t* bytes, uint16_t address);
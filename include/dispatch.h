@@ -0,0 +1,21 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+class CPU;
+class Bus;
+
+/**
+ * Executes one already fetched opcode
+ *
+ * @return number of M cycles the instruction took
+ */
+using OpcodeHandler = int(*)(CPU& cpu, Bus& bus);
+
+/**
+ * Handler tables for the main and CB prefixed opcode spaces. Every entry is either the
+ * register form template or the reference switch in instructions.h specialised for a single
+ * opcode, so both dispatch backends execute exactly the same instruction bodies
+ */
+extern const std::array<OpcodeHandler, 256> opcodeTable;
+extern const std::array<OpcodeHandler, 256> cbOpcodeTable;
@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * Hands finished frames from the emulation thread to any number of consumers (GL upload,
+ * recording, observers) without locks. The producer writes into a slot nobody is reading and
+ * publishes it by swapping one atomic index, consumers always get the latest published frame
+ * and hold it until they let go, so they never see one half written. Frames nobody picked up
+ * in time are simply overwritten, the producer never waits.
+ *
+ * With one consumer this is a triple buffer, each extra consumer adds one more slot so there
+ * is always a free one to write into
+ */
+class FrameQueue{
+public:
+    /**
+     * @param frameBytes size of one frame
+     * @param consumers most frames held by consumers at once, at most one per consumer
+     */
+    explicit FrameQueue(size_t frameBytes, int consumers = 1);
+
+    /**
+     * A published frame held by a consumer, the producer wont reuse its slot until it is
+     * destroyed. Empty if nothing was published yet
+     */
+    class Frame{
+    public:
+        Frame() = default;
+        Frame(Frame&& other) noexcept;
+        Frame& operator=(Frame&& other) noexcept;
+        Frame(const Frame&) = delete;
+        Frame& operator=(const Frame&) = delete;
+        ~Frame();
+
+        explicit operator bool() const{
+            return queue != nullptr;
+        }
+
+        const uint8_t* data() const;
+
+        // number the producer published the frame with
+        uint64_t number() const;
+
+        // lets go of the slot early, the frame is empty afterwards
+        void release();
+
+    private:
+        friend class FrameQueue;
+        Frame(FrameQueue* queue, int slot) : queue(queue), slot(slot){}
+
+        FrameQueue* queue = nullptr;
+        int slot = -1;
+    };
+
+    /**
+     * Producer side, where the next frame goes. Stays the same until publish()
+     */
+    uint8_t* writeBuffer(){
+        return storage.data() + size_t(writeSlot) * frameBytes;
+    }
+
+    /**
+     * Producer side, makes the write buffer the latest frame and moves on to a free slot
+     *
+     * @param number passed on to consumers, eg the PPU's frame count
+     */
+    void publish(uint64_t number);
+
+    /**
+     * Consumer side, takes the latest published frame. A consumer must let go of the frame it
+     * holds before acquiring another, or the producer can run out of free slots
+     *
+     * @return the frame, empty if nothing was published yet
+     */
+    Frame acquire();
+
+    size_t getFrameBytes() const{
+        return frameBytes;
+    }
+
+    // frames published so far
+    uint64_t getPublished() const{
+        return published.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot{
+        alignas(64) std::atomic<uint32_t> readers{0}; // consumers holding or about to hold it
+        uint64_t number = 0; // written before the slot is published, read after
+    };
+
+    size_t frameBytes;
+    int slotCount;
+    std::unique_ptr<Slot[]> slots;
+    std::vector<uint8_t> storage;
+
+    int writeSlot = 0; // only the producer touches it
+    alignas(64) std::atomic<int> latest{-1}; // last published slot
+    alignas(64) std::atomic<uint64_t> published{0};
+};
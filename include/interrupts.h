@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+
+class IO;
+
+/**
+ * Owns IE (0xFFFF) and IF (0xFF0F) and keeps IE & IF up to date as either changes, so the
+ * cpu can check for a pending interrupt before every instruction without touching the bus
+ */
+class InterruptController{
+public:
+    /**
+     * Attaches IF to the IO page, IE lives outside it and is routed here by the bus
+     *
+     * @param io the IO page
+     */
+    void mapRegisters(IO& io);
+
+    /**
+     * Reads IF or IE
+     *
+     * @param address 0xFF0F or 0xFFFF
+     * @return the register
+     */
+    uint8_t read(uint16_t address) const{
+        return address == IE_ADDRESS ? IE : IF;
+    }
+
+    /**
+     * Writes IF or IE
+     *
+     * @param address 0xFF0F or 0xFFFF
+     * @param byte the byte written
+     */
+    void write(uint16_t address, uint8_t byte){
+        if(address == IE_ADDRESS){
+            IE = byte;
+        }else{
+            IF = byte & 0x1F;
+        }
+        pending = IE & IF & 0x1F;
+    }
+
+    /**
+     * Sets a bit in IF, called by whatever raises the interrupt
+     *
+     * @param bit 0 VBLANK, 1 LCD, 2 TIMER, 3 SERIAL, 4 JOYPAD
+     */
+    void request(uint8_t bit){
+        IF |= uint8_t(1 << bit);
+        pending = IE & IF & 0x1F;
+    }
+
+    /**
+     * Clears a bit in IF once the cpu has started servicing it
+     *
+     * @param bit 0-4 like request()
+     */
+    void acknowledge(uint8_t bit){
+        IF &= uint8_t(~(1 << bit));
+        pending = IE & IF & 0x1F;
+    }
+
+    bool hasPending() const{
+        return pending != 0;
+    }
+
+    // requested and enabled interrupts, bit 0 has the highest priority
+    uint8_t getPending() const{
+        return pending;
+    }
+
+    static constexpr uint16_t IF_ADDRESS = 0xFF0F;
+    static constexpr uint16_t IE_ADDRESS = 0xFFFF;
+private:
+    uint8_t IE = 0x00;
+    uint8_t IF = 0x01; // only bits 0-4 are stored, IO reads the rest back as 1
+    uint8_t pending = 0;
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * The 0xFF00-0xFF7F register page. Peripherals hand the registers they own to attach() and get
+ * their read and write called for them, anything nobody attached is plain storage
+ */
+class IO{
+public:
+    static constexpr uint16_t BASE_ADDRESS = 0xFF00;
+    static constexpr int REGISTER_COUNT = 0x80;
+
+    using ReadHandler = uint8_t(*)(void* owner, uint16_t address);
+    using WriteHandler = void(*)(void* owner, uint16_t address, uint8_t byte);
+
+    /**
+     * Routes first..last to owner.read(address) and owner.write(address, byte)
+     *
+     * @param first first register address, 0xFF00-0xFF7F
+     * @param last last register address, inclusive
+     * @param owner the peripheral the registers belong to
+     */
+    template<class T>
+    void attach(uint16_t first, uint16_t last, T& owner){
+        ReadHandler read = [](void* peripheral, uint16_t address){
+            return static_cast<T*>(peripheral)->read(address);
+        };
+        WriteHandler write = [](void* peripheral, uint16_t address, uint8_t byte){
+            static_cast<T*>(peripheral)->write(address, byte);
+        };
+        for(uint16_t address = first; address <= last; ++address){
+            Register& reg = registers[address - BASE_ADDRESS];
+            reg.owner = &owner;
+            reg.read = read;
+            reg.write = write;
+        }
+    }
+
+    /**
+     * Sets which bits of a register dont exist and which ones software can change
+     *
+     * @param address register address
+     * @param unusedBits bits that always read back as 1
+     * @param writableBits bits a write changes, the rest keep their current value
+     */
+    void setMasks(uint16_t address, uint8_t unusedBits, uint8_t writableBits){
+        Register& reg = registers[address - BASE_ADDRESS];
+        reg.unusedBits = unusedBits;
+        reg.writableBits = writableBits;
+    }
+
+    /**
+     * @param address 16 bit address in 0xFF00-0xFF7F
+     * @return value of the register with unused bits set
+     */
+    uint8_t read(uint16_t address){
+        const Register& reg = registers[address - BASE_ADDRESS];
+        return readRegister(reg, address) | reg.unusedBits;
+    }
+
+    /**
+     * @param address 16 bit address in 0xFF00-0xFF7F
+     * @param byte value written, bits that arent writable are ignored
+     */
+    void write(uint16_t address, uint8_t byte){
+        Register& reg = registers[address - BASE_ADDRESS];
+        if(reg.writableBits != 0xFF){
+            byte = (readRegister(reg, address) & ~reg.writableBits) | (byte & reg.writableBits);
+        }
+        if(reg.write){
+            reg.write(reg.owner, address, byte);
+        }else{
+            reg.value = byte;
+        }
+    }
+private:
+    struct Register{
+        void* owner = nullptr;
+        ReadHandler read = nullptr; // nullptr means value is the register
+        WriteHandler write = nullptr;
+        uint8_t value = 0;
+        uint8_t unusedBits = 0;
+        uint8_t writableBits = 0xFF;
+    };
+
+    Register registers[REGISTER_COUNT];
+
+    uint8_t readRegister(const Register& reg, uint16_t address){
+        return reg.read ? reg.read(reg.owner, address) : reg.value;
+    }
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "blockcache.h"
+
+class CPU;
+
+/**
+ * Translates hot ROM blocks from the block cache into native x86-64 code.
+ *
+ * Register loads, 16 bit increments and the 8 bit ALU forms are emitted as native code that
+ * updates the CPU fields directly and defers flags the same way the interpreter does, jumps
+ * at the end of a block test those deferred flags natively. Their cycles are summed at compile
+ * time and handed to Bus::step in one go, at the block exit or before the next instruction
+ * that has to go through its opcode handler (memory access, stack, ADC/SBC, CB ops). After a
+ * handler the block leaves early when anything the interpreter would react to between
+ * instructions has happened (pending interrupt, HALT, finished frame, OAM DMA, bank switch).
+ *
+ * A block is only entered when it finishes before the next scheduler event, otherwise that
+ * stretch is interpreted, so events and the interrupts they raise land on the same
+ * instruction as with the other backends. Accurate timing bypasses it
+ */
+class Jit{
+public:
+    Jit(CPU& cpu);
+    ~Jit();
+
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    /**
+     * False on hosts without an x86-64 code generator, blocks are then never compiled
+     */
+    bool available() const{
+        return code != nullptr;
+    }
+
+    /**
+     * Emits native code for a block and stores its entry point in block.compiled
+     *
+     * @param block decoded block to translate
+     * @return true if the block was compiled
+     */
+    bool compile(BasicBlock& block);
+
+    /**
+     * Runs a compiled block from its first instruction
+     *
+     * @param block block with native code
+     * @return M cycles of the last instruction run that still need to be passed to Bus::step
+     */
+    int run(const BasicBlock& block);
+
+    // blocks entered this many times get compiled
+    static constexpr uint32_t HOT_THRESHOLD = 16;
+private:
+    CPU& cpu;
+
+    uint8_t* code = nullptr; // executable arena, blocks are appended until it is full
+    size_t used = 0;
+    uint32_t entryBankSwitchCount = 0; // bank mapping the running block was entered with
+
+    static constexpr size_t CODE_CAPACITY = 16 * 1024 * 1024;
+
+    // called from compiled code, pendingCycles are the native ones since the last Bus::step
+    static int executeInstruction(CPU* cpu, const DecodedInstruction* instruction, int pendingCycles);
+    static int executeInBlock(CPU* cpu, const DecodedInstruction* instruction, int pendingCycles);
+    static int carry(CPU* cpu);
+};
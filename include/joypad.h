@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+
+class IO;
+
+class Joypad{
+public:
+    Joypad();
+
+    /**
+     * Attaches JOYP to the IO page
+     *
+     * @param io the IO page
+     */
+    void mapRegisters(IO& io);
+
+    /**
+     * Reads JOYP 0xFF00, the selected button group reads active low
+     *
+     * @param address always 0xFF00
+     * @return the register
+     */
+    uint8_t read(uint16_t address) const;
+    /**
+     * Writes JOYP 0xFF00, only the group select bits 4 and 5 get this far
+     *
+     * @param address always 0xFF00
+     * @param byte the byte written
+     */
+    void write(uint16_t address, uint8_t byte);
+
+    /**
+     * Sets the state for the joyp register to emulate key presses
+     *
+     * @param keyState array containing bools pressed/not pressed for each key
+     * @return true if a key was just pressed, which requests the joypad interrupt
+     */
+    bool setKeyState(const bool keyState[8]);
+
+    static constexpr uint16_t JOYP_ADDRESS = 0xFF00;
+private:
+    uint8_t select = 0x00; // bits 4 and 5 of JOYP, 0 selects that group
+    bool keys[8]{}; // current key states. true = pressed
+};
@@ -0,0 +1,349 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+/**
+ * Compile time description of every opcode, shared by the interpreter (register forms are
+ * generated from it, see instructions.h), the block cache, the disassembler and the cycle checks
+ * at the bottom of this file
+ */
+struct OpcodeInfo{
+    // immediate operand, named after the placeholder used for it in the mnemonic
+    enum class Operand : uint8_t {
+        NONE,
+        D8, // 8 bit immediate
+        D16, // 16 bit immediate
+        A8, // 8 bit offset into FF00-FFFF
+        A16, // 16 bit address
+        R8, // signed jump offset relative to the next instruction
+        S8 // signed 8 bit immediate added to SP
+    };
+
+    const char* mnemonic;
+    Operand operand;
+    uint8_t length; // total bytes including the opcode, STOP is treated as one byte
+    uint8_t cycles; // M cycles, conditional branches store their not taken cost, 0 = illegal (and CB, costed per CB opcode)
+    uint8_t cyclesTaken; // M cycles when a conditional branch is taken, same as cycles for everything else
+};
+
+using Operand = OpcodeInfo::Operand;
+
+inline constexpr std::array<OpcodeInfo, 256> OPCODES = {{
+    {"NOP", Operand::NONE, 1, 1, 1}, // 0x00
+    {"LD BC, d16", Operand::D16, 3, 3, 3}, // 0x01
+    {"LD (BC), A", Operand::NONE, 1, 2, 2}, // 0x02
+    {"INC BC", Operand::NONE, 1, 2, 2}, // 0x03
+    {"INC B", Operand::NONE, 1, 1, 1}, // 0x04
+    {"DEC B", Operand::NONE, 1, 1, 1}, // 0x05
+    {"LD B, d8", Operand::D8, 2, 2, 2}, // 0x06
+    {"RLCA", Operand::NONE, 1, 1, 1}, // 0x07
+    {"LD (a16), SP", Operand::A16, 3, 5, 5}, // 0x08
+    {"ADD HL, BC", Operand::NONE, 1, 2, 2}, // 0x09
+    {"LD A, (BC)", Operand::NONE, 1, 2, 2}, // 0x0A
+    {"DEC BC", Operand::NONE, 1, 2, 2}, // 0x0B
+    {"INC C", Operand::NONE, 1, 1, 1}, // 0x0C
+    {"DEC C", Operand::NONE, 1, 1, 1}, // 0x0D
+    {"LD C, d8", Operand::D8, 2, 2, 2}, // 0x0E
+    {"RRCA", Operand::NONE, 1, 1, 1}, // 0x0F
+    {"STOP", Operand::NONE, 1, 1, 1}, // 0x10
+    {"LD DE, d16", Operand::D16, 3, 3, 3}, // 0x11
+    {"LD (DE), A", Operand::NONE, 1, 2, 2}, // 0x12
+    {"INC DE", Operand::NONE, 1, 2, 2}, // 0x13
+    {"INC D", Operand::NONE, 1, 1, 1}, // 0x14
+    {"DEC D", Operand::NONE, 1, 1, 1}, // 0x15
+    {"LD D, d8", Operand::D8, 2, 2, 2}, // 0x16
+    {"RLA", Operand::NONE, 1, 1, 1}, // 0x17
+    {"JR r8", Operand::R8, 2, 3, 3}, // 0x18
+    {"ADD HL, DE", Operand::NONE, 1, 2, 2}, // 0x19
+    {"LD A, (DE)", Operand::NONE, 1, 2, 2}, // 0x1A
+    {"DEC DE", Operand::NONE, 1, 2, 2}, // 0x1B
+    {"INC E", Operand::NONE, 1, 1, 1}, // 0x1C
+    {"DEC E", Operand::NONE, 1, 1, 1}, // 0x1D
+    {"LD E, d8", Operand::D8, 2, 2, 2}, // 0x1E
+    {"RRA", Operand::NONE, 1, 1, 1}, // 0x1F
+    {"JR NZ, r8", Operand::R8, 2, 2, 3}, // 0x20
+    {"LD HL, d16", Operand::D16, 3, 3, 3}, // 0x21
+    {"LD (HL+), A", Operand::NONE, 1, 2, 2}, // 0x22
+    {"INC HL", Operand::NONE, 1, 2, 2}, // 0x23
+    {"INC H", Operand::NONE, 1, 1, 1}, // 0x24
+    {"DEC H", Operand::NONE, 1, 1, 1}, // 0x25
+    {"LD H, d8", Operand::D8, 2, 2, 2}, // 0x26
+    {"DAA", Operand::NONE, 1, 1, 1}, // 0x27
+    {"JR Z, r8", Operand::R8, 2, 2, 3}, // 0x28
+    {"ADD HL, HL", Operand::NONE, 1, 2, 2}, // 0x29
+    {"LD A, (HL+)", Operand::NONE, 1, 2, 2}, // 0x2A
+    {"DEC HL", Operand::NONE, 1, 2, 2}, // 0x2B
+    {"INC L", Operand::NONE, 1, 1, 1}, // 0x2C
+    {"DEC L", Operand::NONE, 1, 1, 1}, // 0x2D
+    {"LD L, d8", Operand::D8, 2, 2, 2}, // 0x2E
+    {"CPL", Operand::NONE, 1, 1, 1}, // 0x2F
+    {"JR NC, r8", Operand::R8, 2, 2, 3}, // 0x30
+    {"LD SP, d16", Operand::D16, 3, 3, 3}, // 0x31
+    {"LD (HL-), A", Operand::NONE, 1, 2, 2}, // 0x32
+    {"INC SP", Operand::NONE, 1, 2, 2}, // 0x33
+    {"INC (HL)", Operand::NONE, 1, 3, 3}, // 0x34
+    {"DEC (HL)", Operand::NONE, 1, 3, 3}, // 0x35
+    {"LD (HL), d8", Operand::D8, 2, 3, 3}, // 0x36
+    {"SCF", Operand::NONE, 1, 1, 1}, // 0x37
+    {"JR C, r8", Operand::R8, 2, 2, 3}, // 0x38
+    {"ADD HL, SP", Operand::NONE, 1, 2, 2}, // 0x39
+    {"LD A, (HL-)", Operand::NONE, 1, 2, 2}, // 0x3A
+    {"DEC SP", Operand::NONE, 1, 2, 2}, // 0x3B
+    {"INC A", Operand::NONE, 1, 1, 1}, // 0x3C
+    {"DEC A", Operand::NONE, 1, 1, 1}, // 0x3D
+    {"LD A, d8", Operand::D8, 2, 2, 2}, // 0x3E
+    {"CCF", Operand::NONE, 1, 1, 1}, // 0x3F
+    {"LD B, B", Operand::NONE, 1, 1, 1}, // 0x40
+    {"LD B, C", Operand::NONE, 1, 1, 1}, // 0x41
+    {"LD B, D", Operand::NONE, 1, 1, 1}, // 0x42
+    {"LD B, E", Operand::NONE, 1, 1, 1}, // 0x43
+    {"LD B, H", Operand::NONE, 1, 1, 1}, // 0x44
+    {"LD B, L", Operand::NONE, 1, 1, 1}, // 0x45
+    {"LD B, (HL)", Operand::NONE, 1, 2, 2}, // 0x46
+    {"LD B, A", Operand::NONE, 1, 1, 1}, // 0x47
+    {"LD C, B", Operand::NONE, 1, 1, 1}, // 0x48
+    {"LD C, C", Operand::NONE, 1, 1, 1}, // 0x49
+    {"LD C, D", Operand::NONE, 1, 1, 1}, // 0x4A
+    {"LD C, E", Operand::NONE, 1, 1, 1}, // 0x4B
+    {"LD C, H", Operand::NONE, 1, 1, 1}, // 0x4C
+    {"LD C, L", Operand::NONE, 1, 1, 1}, // 0x4D
+    {"LD C, (HL)", Operand::NONE, 1, 2, 2}, // 0x4E
+    {"LD C, A", Operand::NONE, 1, 1, 1}, // 0x4F
+    {"LD D, B", Operand::NONE, 1, 1, 1}, // 0x50
+    {"LD D, C", Operand::NONE, 1, 1, 1}, // 0x51
+    {"LD D, D", Operand::NONE, 1, 1, 1}, // 0x52
+    {"LD D, E", Operand::NONE, 1, 1, 1}, // 0x53
+    {"LD D, H", Operand::NONE, 1, 1, 1}, // 0x54
+    {"LD D, L", Operand::NONE, 1, 1, 1}, // 0x55
+    {"LD D, (HL)", Operand::NONE, 1, 2, 2}, // 0x56
+    {"LD D, A", Operand::NONE, 1, 1, 1}, // 0x57
+    {"LD E, B", Operand::NONE, 1, 1, 1}, // 0x58
+    {"LD E, C", Operand::NONE, 1, 1, 1}, // 0x59
+    {"LD E, D", Operand::NONE, 1, 1, 1}, // 0x5A
+    {"LD E, E", Operand::NONE, 1, 1, 1}, // 0x5B
+    {"LD E, H", Operand::NONE, 1, 1, 1}, // 0x5C
+    {"LD E, L", Operand::NONE, 1, 1, 1}, // 0x5D
+    {"LD E, (HL)", Operand::NONE, 1, 2, 2}, // 0x5E
+    {"LD E, A", Operand::NONE, 1, 1, 1}, // 0x5F
+    {"LD H, B", Operand::NONE, 1, 1, 1}, // 0x60
+    {"LD H, C", Operand::NONE, 1, 1, 1}, // 0x61
+    {"LD H, D", Operand::NONE, 1, 1, 1}, // 0x62
+    {"LD H, E", Operand::NONE, 1, 1, 1}, // 0x63
+    {"LD H, H", Operand::NONE, 1, 1, 1}, // 0x64
+    {"LD H, L", Operand::NONE, 1, 1, 1}, // 0x65
+    {"LD H, (HL)", Operand::NONE, 1, 2, 2}, // 0x66
+    {"LD H, A", Operand::NONE, 1, 1, 1}, // 0x67
+    {"LD L, B", Operand::NONE, 1, 1, 1}, // 0x68
+    {"LD L, C", Operand::NONE, 1, 1, 1}, // 0x69
+    {"LD L, D", Operand::NONE, 1, 1, 1}, // 0x6A
+    {"LD L, E", Operand::NONE, 1, 1, 1}, // 0x6B
+    {"LD L, H", Operand::NONE, 1, 1, 1}, // 0x6C
+    {"LD L, L", Operand::NONE, 1, 1, 1}, // 0x6D
+    {"LD L, (HL)", Operand::NONE, 1, 2, 2}, // 0x6E
+    {"LD L, A", Operand::NONE, 1, 1, 1}, // 0x6F
+    {"LD (HL), B", Operand::NONE, 1, 2, 2}, // 0x70
+    {"LD (HL), C", Operand::NONE, 1, 2, 2}, // 0x71
+    {"LD (HL), D", Operand::NONE, 1, 2, 2}, // 0x72
+    {"LD (HL), E", Operand::NONE, 1, 2, 2}, // 0x73
+    {"LD (HL), H", Operand::NONE, 1, 2, 2}, // 0x74
+    {"LD (HL), L", Operand::NONE, 1, 2, 2}, // 0x75
+    {"HALT", Operand::NONE, 1, 1, 1}, // 0x76
+    {"LD (HL), A", Operand::NONE, 1, 2, 2}, // 0x77
+    {"LD A, B", Operand::NONE, 1, 1, 1}, // 0x78
+    {"LD A, C", Operand::NONE, 1, 1, 1}, // 0x79
+    {"LD A, D", Operand::NONE, 1, 1, 1}, // 0x7A
+    {"LD A, E", Operand::NONE, 1, 1, 1}, // 0x7B
+    {"LD A, H", Operand::NONE, 1, 1, 1}, // 0x7C
+    {"LD A, L", Operand::NONE, 1, 1, 1}, // 0x7D
+    {"LD A, (HL)", Operand::NONE, 1, 2, 2}, // 0x7E
+    {"LD A, A", Operand::NONE, 1, 1, 1}, // 0x7F
+    {"ADD A, B", Operand::NONE, 1, 1, 1}, // 0x80
+    {"ADD A, C", Operand::NONE, 1, 1, 1}, // 0x81
+    {"ADD A, D", Operand::NONE, 1, 1, 1}, // 0x82
+    {"ADD A, E", Operand::NONE, 1, 1, 1}, // 0x83
+    {"ADD A, H", Operand::NONE, 1, 1, 1}, // 0x84
+    {"ADD A, L", Operand::NONE, 1, 1, 1}, // 0x85
+    {"ADD A, (HL)", Operand::NONE, 1, 2, 2}, // 0x86
+    {"ADD A, A", Operand::NONE, 1, 1, 1}, // 0x87
+    {"ADC A, B", Operand::NONE, 1, 1, 1}, // 0x88
+    {"ADC A, C", Operand::NONE, 1, 1, 1}, // 0x89
+    {"ADC A, D", Operand::NONE, 1, 1, 1}, // 0x8A
+    {"ADC A, E", Operand::NONE, 1, 1, 1}, // 0x8B
+    {"ADC A, H", Operand::NONE, 1, 1, 1}, // 0x8C
+    {"ADC A, L", Operand::NONE, 1, 1, 1}, // 0x8D
+    {"ADC A, (HL)", Operand::NONE, 1, 2, 2}, // 0x8E
+    {"ADC A, A", Operand::NONE, 1, 1, 1}, // 0x8F
+    {"SUB B", Operand::NONE, 1, 1, 1}, // 0x90
+    {"SUB C", Operand::NONE, 1, 1, 1}, // 0x91
+    {"SUB D", Operand::NONE, 1, 1, 1}, // 0x92
+    {"SUB E", Operand::NONE, 1, 1, 1}, // 0x93
+    {"SUB H", Operand::NONE, 1, 1, 1}, // 0x94
+    {"SUB L", Operand::NONE, 1, 1, 1}, // 0x95
+    {"SUB (HL)", Operand::NONE, 1, 2, 2}, // 0x96
+    {"SUB A", Operand::NONE, 1, 1, 1}, // 0x97
+    {"SBC A, B", Operand::NONE, 1, 1, 1}, // 0x98
+    {"SBC A, C", Operand::NONE, 1, 1, 1}, // 0x99
+    {"SBC A, D", Operand::NONE, 1, 1, 1}, // 0x9A
+    {"SBC A, E", Operand::NONE, 1, 1, 1}, // 0x9B
+    {"SBC A, H", Operand::NONE, 1, 1, 1}, // 0x9C
+    {"SBC A, L", Operand::NONE, 1, 1, 1}, // 0x9D
+    {"SBC A, (HL)", Operand::NONE, 1, 2, 2}, // 0x9E
+    {"SBC A, A", Operand::NONE, 1, 1, 1}, // 0x9F
+    {"AND B", Operand::NONE, 1, 1, 1}, // 0xA0
+    {"AND C", Operand::NONE, 1, 1, 1}, // 0xA1
+    {"AND D", Operand::NONE, 1, 1, 1}, // 0xA2
+    {"AND E", Operand::NONE, 1, 1, 1}, // 0xA3
+    {"AND H", Operand::NONE, 1, 1, 1}, // 0xA4
+    {"AND L", Operand::NONE, 1, 1, 1}, // 0xA5
+    {"AND (HL)", Operand::NONE, 1, 2, 2}, // 0xA6
+    {"AND A", Operand::NONE, 1, 1, 1}, // 0xA7
+    {"XOR B", Operand::NONE, 1, 1, 1}, // 0xA8
+    {"XOR C", Operand::NONE, 1, 1, 1}, // 0xA9
+    {"XOR D", Operand::NONE, 1, 1, 1}, // 0xAA
+    {"XOR E", Operand::NONE, 1, 1, 1}, // 0xAB
+    {"XOR H", Operand::NONE, 1, 1, 1}, // 0xAC
+    {"XOR L", Operand::NONE, 1, 1, 1}, // 0xAD
+    {"XOR (HL)", Operand::NONE, 1, 2, 2}, // 0xAE
+    {"XOR A", Operand::NONE, 1, 1, 1}, // 0xAF
+    {"OR B", Operand::NONE, 1, 1, 1}, // 0xB0
+    {"OR C", Operand::NONE, 1, 1, 1}, // 0xB1
+    {"OR D", Operand::NONE, 1, 1, 1}, // 0xB2
+    {"OR E", Operand::NONE, 1, 1, 1}, // 0xB3
+    {"OR H", Operand::NONE, 1, 1, 1}, // 0xB4
+    {"OR L", Operand::NONE, 1, 1, 1}, // 0xB5
+    {"OR (HL)", Operand::NONE, 1, 2, 2}, // 0xB6
+    {"OR A", Operand::NONE, 1, 1, 1}, // 0xB7
+    {"CP B", Operand::NONE, 1, 1, 1}, // 0xB8
+    {"CP C", Operand::NONE, 1, 1, 1}, // 0xB9
+    {"CP D", Operand::NONE, 1, 1, 1}, // 0xBA
+    {"CP E", Operand::NONE, 1, 1, 1}, // 0xBB
+    {"CP H", Operand::NONE, 1, 1, 1}, // 0xBC
+    {"CP L", Operand::NONE, 1, 1, 1}, // 0xBD
+    {"CP (HL)", Operand::NONE, 1, 2, 2}, // 0xBE
+    {"CP A", Operand::NONE, 1, 1, 1}, // 0xBF
+    {"RET NZ", Operand::NONE, 1, 2, 5}, // 0xC0
+    {"POP BC", Operand::NONE, 1, 3, 3}, // 0xC1
+    {"JP NZ, a16", Operand::A16, 3, 3, 4}, // 0xC2
+    {"JP a16", Operand::A16, 3, 4, 4}, // 0xC3
+    {"CALL NZ, a16", Operand::A16, 3, 3, 6}, // 0xC4
+    {"PUSH BC", Operand::NONE, 1, 4, 4}, // 0xC5
+    {"ADD A, d8", Operand::D8, 2, 2, 2}, // 0xC6
+    {"RST 00H", Operand::NONE, 1, 4, 4}, // 0xC7
+    {"RET Z", Operand::NONE, 1, 2, 5}, // 0xC8
+    {"RET", Operand::NONE, 1, 4, 4}, // 0xC9
+    {"JP Z, a16", Operand::A16, 3, 3, 4}, // 0xCA
+    {"PREFIX CB", Operand::NONE, 2, 0, 0}, // 0xCB
+    {"CALL Z, a16", Operand::A16, 3, 3, 6}, // 0xCC
+    {"CALL a16", Operand::A16, 3, 6, 6}, // 0xCD
+    {"ADC A, d8", Operand::D8, 2, 2, 2}, // 0xCE
+    {"RST 08H", Operand::NONE, 1, 4, 4}, // 0xCF
+    {"RET NC", Operand::NONE, 1, 2, 5}, // 0xD0
+    {"POP DE", Operand::NONE, 1, 3, 3}, // 0xD1
+    {"JP NC, a16", Operand::A16, 3, 3, 4}, // 0xD2
+    {"ILLEGAL", Operand::NONE, 1, 0, 0}, // 0xD3
+    {"CALL NC, a16", Operand::A16, 3, 3, 6}, // 0xD4
+    {"PUSH DE", Operand::NONE, 1, 4, 4}, // 0xD5
+    {"SUB d8", Operand::D8, 2, 2, 2}, // 0xD6
+    {"RST 10H", Operand::NONE, 1, 4, 4}, // 0xD7
+    {"RET C", Operand::NONE, 1, 2, 5}, // 0xD8
+    {"RETI", Operand::NONE, 1, 4, 4}, // 0xD9
+    {"JP C, a16", Operand::A16, 3, 3, 4}, // 0xDA
+    {"ILLEGAL", Operand::NONE, 1, 0, 0}, // 0xDB
+    {"CALL C, a16", Operand::A16, 3, 3, 6}, // 0xDC
+    {"ILLEGAL", Operand::NONE, 1, 0, 0}, // 0xDD
+    {"SBC A, d8", Operand::D8, 2, 2, 2}, // 0xDE
+    {"RST 18H", Operand::NONE, 1, 4, 4}, // 0xDF
+    {"LDH (a8), A", Operand::A8, 2, 3, 3}, // 0xE0
+    {"POP HL", Operand::NONE, 1, 3, 3}, // 0xE1
+    {"LD (C), A", Operand::NONE, 1, 2, 2}, // 0xE2
+    {"ILLEGAL", Operand::NONE, 1, 0, 0}, // 0xE3
+    {"ILLEGAL", Operand::NONE, 1, 0, 0}, // 0xE4
+    {"PUSH HL", Operand::NONE, 1, 4, 4}, // 0xE5
+    {"AND d8", Operand::D8, 2, 2, 2}, // 0xE6
+    {"RST 20H", Operand::NONE, 1, 4, 4}, // 0xE7
+    {"ADD SP, s8", Operand::S8, 2, 4, 4}, // 0xE8
+    {"JP HL", Operand::NONE, 1, 1, 1}, // 0xE9
+    {"LD (a16), A", Operand::A16, 3, 4, 4}, // 0xEA
+    {"ILLEGAL", Operand::NONE, 1, 0, 0}, // 0xEB
+    {"ILLEGAL", Operand::NONE, 1, 0, 0}, // 0xEC
+    {"ILLEGAL", Operand::NONE, 1, 0, 0}, // 0xED
+    {"XOR d8", Operand::D8, 2, 2, 2}, // 0xEE
+    {"RST 28H", Operand::NONE, 1, 4, 4}, // 0xEF
+    {"LDH A, (a8)", Operand::A8, 2, 3, 3}, // 0xF0
+    {"POP AF", Operand::NONE, 1, 3, 3}, // 0xF1
+    {"LD A, (C)", Operand::NONE, 1, 2, 2}, // 0xF2
+    {"DI", Operand::NONE, 1, 1, 1}, // 0xF3
+    {"ILLEGAL", Operand::NONE, 1, 0, 0}, // 0xF4
+    {"PUSH AF", Operand::NONE, 1, 4, 4}, // 0xF5
+    {"OR d8", Operand::D8, 2, 2, 2}, // 0xF6
+    {"RST 30H", Operand::NONE, 1, 4, 4}, // 0xF7
+    {"LD HL, SP+s8", Operand::S8, 2, 3, 3}, // 0xF8
+    {"LD SP, HL", Operand::NONE, 1, 2, 2}, // 0xF9
+    {"LD A, (a16)", Operand::A16, 3, 4, 4}, // 0xFA
+    {"EI", Operand::NONE, 1, 1, 1}, // 0xFB
+    {"ILLEGAL", Operand::NONE, 1, 0, 0}, // 0xFC
+    {"ILLEGAL", Operand::NONE, 1, 0, 0}, // 0xFD
+    {"CP d8", Operand::D8, 2, 2, 2}, // 0xFE
+    {"RST 38H", Operand::NONE, 1, 4, 4}, // 0xFF
+}};
+
+// operand order shared by the register forms, 6 is (HL)
+inline constexpr const char* OPERAND_NAMES[8] = {"B", "C", "D", "E", "H", "L", "(HL)", "A"};
+
+inline constexpr const char* CB_OPERATIONS[8] = {"RLC", "RRC", "RL", "RR", "SLA", "SRA", "SWAP", "SRL"};
+
+/**
+ * M cycles of a CB prefixed opcode including the prefix. The CB space is fully regular so it
+ * is worked out from the opcode instead of being tabled
+ */
+constexpr uint8_t cbOpcodeCycles(uint8_t cbOpcode){
+    if((cbOpcode & 0x07) != 6) return 2;
+    return (cbOpcode >> 6) == 1 ? 3 : 4; // BIT only reads (HL) back, the rest write it as well
+}
+
+/**
+ * Opcodes whose handler is generated from the operand fields instead of written out by hand,
+ * LD r, r' / LD r, d8 / INC r / DEC r / ALU A, r / ALU A, d8
+ */
+constexpr bool isRegisterForm(uint8_t opcode){
+    uint8_t x = opcode >> 6;
+    uint8_t z = opcode & 0x07;
+    if(x == 0) return z == 4 || z == 5 || z == 6;
+    if(x == 1) return opcode != 0x76; // HALT sits where LD (HL), (HL) would be
+    if(x == 2) return true;
+    return z == 6;
+}
+
+// cycle checks, catches a typo in the table before it turns into a timing bug
+constexpr bool opcodeTableIsConsistent(){
+    for(int op = 0; op < 256; ++op){
+        const OpcodeInfo& info = OPCODES[op];
+        if(info.cyclesTaken < info.cycles) return false;
+
+        uint8_t expectedLength = 1;
+        switch(info.operand){
+            case Operand::NONE: expectedLength = op == 0xCB ? 2 : 1; break;
+            case Operand::D16:
+            case Operand::A16: expectedLength = 3; break;
+            default: expectedLength = 2; break;
+        }
+        if(info.length != expectedLength) return false;
+
+        // every instruction costs at least an M cycle per byte fetched
+        if(info.cycles != 0 && info.cycles < info.length) return false;
+
+        if(isRegisterForm(uint8_t(op))){
+            // register forms cost 1, plus 1 per immediate and per (HL) access, INC/DEC (HL) read and write
+            uint8_t x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+            int expected = info.length;
+            if(x == 0 && z != 6 && y == 6) expected += 2;
+            if(x == 0 && z == 6 && y == 6) expected += 1;
+            if(x == 1 && (y == 6 || z == 6)) expected += 1;
+            if(x == 2 && z == 6) expected += 1;
+            if(info.cycles != expected || info.cyclesTaken != expected) return false;
+        }
+    }
+    return true;
+}
+
+static_assert(opcodeTableIsConsistent(), "opcode table lengths or cycle counts dont add up");
\ No newline at end of file
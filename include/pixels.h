@@ -0,0 +1,137 @@
+#pragma once
+#include <cstdint>
+
+// layouts the PPU can write finished lines in, see PPU::setOutput
+enum class PixelFormat : uint8_t {
+    INDEXED8, // one byte per pixel, the shade 0-3
+    PACKED2BPP, // four pixels per byte, leftmost in bits 7-6
+    RGB565, // one uint16_t per pixel through the palette
+    RGBA8888 // one uint32_t per pixel through the palette, red in the lowest byte
+};
+
+/**
+ * The per pixel loops of the PPU: tile row decoding, palette mapping and converting shades
+ * to the output pixel formats. Each has a scalar, an SSE2 and an AVX2 version, the best
+ * one the host cpu supports is picked the first time get() is called
+ */
+class PixelKernels{
+public:
+    enum class Level : uint8_t {
+        SCALAR,
+        SSE2,
+        AVX2
+    };
+
+    /**
+     * Splits a tile row's two bitplanes into 8 colour indices, leftmost pixel first
+     *
+     * @param low first byte of the row
+     * @param high second byte of the row
+     * @param out 8 colour indices
+     */
+    void (*decodeTileRow)(uint8_t low, uint8_t high, uint8_t* out);
+
+    /**
+     * Merges a line of background colour indices with sprite pixels and maps both through their palettes
+     *
+     * @param bg background/window colour indices 0-3
+     * @param sprites sprite pixels, bits 1-0 colour (0 = none), bit 2 OBP1, bit 3 behind background
+     * @param bgp BGP
+     * @param obp0 OBP0
+     * @param obp1 OBP1
+     * @param out shades 0-3
+     * @param count pixels in the line
+     */
+    void (*composeLine)(const uint8_t* bg, const uint8_t* sprites, uint8_t bgp, uint8_t obp0, uint8_t obp1,
+                        uint8_t* out, int count);
+
+    /**
+     * Expands shades into 32 bit colours
+     *
+     * @param shades shades 0-3, higher bits are ignored
+     * @param palette colour for each shade
+     * @param out one colour per shade
+     * @param count number of shades
+     */
+    void (*expandShades)(const uint8_t* shades, const uint32_t palette[4], uint32_t* out, int count);
+
+    /**
+     * Expands shades into 16 bit colours
+     *
+     * @param shades shades 0-3, higher bits are ignored
+     * @param palette colour for each shade
+     * @param out one colour per shade
+     * @param count number of shades
+     */
+    void (*expandShades16)(const uint8_t* shades, const uint16_t palette[4], uint16_t* out, int count);
+
+    /**
+     * Packs shades four to a byte, the first in bits 7-6
+     *
+     * @param shades shades 0-3, higher bits are ignored
+     * @param out count / 4 bytes
+     * @param count number of shades, a multiple of 4
+     */
+    void (*packShades)(const uint8_t* shades, uint8_t* out, int count);
+
+    Level level;
+
+    /**
+     * One pixel of composeLine, for drawing a pixel at a time
+     *
+     * @param bg background/window colour index 0-3
+     * @param sprite sprite pixel in the composeLine layout
+     * @param bgp BGP
+     * @param obp0 OBP0
+     * @param obp1 OBP1
+     * @return shade 0-3
+     */
+    static uint8_t composePixel(uint8_t bg, uint8_t sprite, uint8_t bgp, uint8_t obp0, uint8_t obp1){
+        // if objs priority flag is clear (obj over backg), it covers background regardless of backgrounds colour
+        // if objs priority flag is set (obj behind backg), it only shows when the background pixel is colour 0
+        bool spriteCovers = (sprite & 0x03) != 0 && (!(sprite & 0x08) || bg == 0);
+        uint8_t palette = spriteCovers ? ((sprite & 0x04) ? obp1 : obp0) : bgp;
+        uint8_t index = spriteCovers ? (sprite & 0x03) : bg;
+        return (palette >> (index * 2)) & 0x03;
+    }
+
+    /**
+     * @param format pixel layout
+     * @return bytes a 160 pixel line takes
+     */
+    static constexpr int lineBytes(PixelFormat format){
+        switch(format){
+            case PixelFormat::PACKED2BPP: return 160 / 4;
+            case PixelFormat::RGB565: return 160 * 2;
+            case PixelFormat::RGBA8888: return 160 * 4;
+            default: return 160;
+        }
+    }
+
+    /**
+     * @param colour RGBA8888 colour, red in the lowest byte
+     * @return the same colour as RGB565
+     */
+    static constexpr uint16_t toRgb565(uint32_t colour){
+        uint32_t r = colour & 0xFF, g = (colour >> 8) & 0xFF, b = (colour >> 16) & 0xFF;
+        return uint16_t((r >> 3) << 11 | (g >> 2) << 5 | (b >> 3));
+    }
+
+    /**
+     * @return the kernels in use, the same object for the whole run
+     */
+    static const PixelKernels& get();
+
+    /**
+     * @return the best level the host cpu supports
+     */
+    static Level detect();
+
+    /**
+     * Switches the kernels get() returns, for comparing levels against each other
+     *
+     * @param level level to use
+     * @return false if the host cpu cant run it, nothing changes then
+     */
+    static bool select(Level level);
+};
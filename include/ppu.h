@@ -1,22 +1,51 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 #include <vector>
-#include <deque>
+#include <array>
+#include <functional>
+#include "pixels.h"
 
 class Bus;
 class CPU;
+class IO;
+class FrameQueue;
 
-class PPU{
+// how the PPU turns VRAM into pixels, both share everything else
+enum class PPUFidelity : uint8_t {
+    SCANLINE, // each line drawn in one go at the end of mode 3, fast
+    FIFO // pixels shifted out one dot at a time, sees SCX, palette and window changes mid line
+};
+
+template<PPUFidelity Fidelity>
+class BasicPPU{
 public:
-    PPU(Bus& bus);
+    BasicPPU(Bus& bus);
 
     /**
-     * Advance the PPU by tStates
+     * Runs the PPU up to the scheduler's time. Called before anything reads or writes PPU state,
+     * the rest of the time the PPU only runs when its next mode change is due
+     */
+    void catchUp();
+
+    /**
+     * Catches up and schedules the next mode change, called when Scheduler::PPU is due
+     */
+    void onEvent();
+
+    /**
+     * @return scheduler time the PPU has been run up to
+     */
+    uint64_t getLastSync() const{
+        return lastSync;
+    }
+
+    /**
+     * Attaches the LCD registers FF40-FF4B to the IO page
      * 
-     * @param tStates
-     * @param cpu reference to cpu
+     * @param io the IO page
      */
-    void step(int tStates, CPU& cpu);
+    void mapRegisters(IO& io);
 
     /**
      * Access for PPU regions 0x8000-0xFF4B
@@ -24,7 +53,7 @@ public:
      * @param address 16 bit address to read from
      * @return byte at the address
      */
-    uint8_t read(uint16_t address) const;
+    uint8_t read(uint16_t address);
 
     /**
      * Write byte to PPU memory region
@@ -36,12 +65,45 @@ public:
 
     /**
      * Once full frame is rady copy pixels into 160x144 buffer
-     * Pixel values are 0-3 indices
+     * Pixel values are 0-3 indices. The PPU keeps drawing into it, so only the emulation
+     * thread can read it, other threads get frames through setFrameQueue
      */
     const uint8_t* getFrameBuffer() const{
         return frameBuffer;
     }
 
+    /**
+     * Has the PPU also write each line it draws straight into buffer, converted to format, so
+     * frontends dont have to convert the whole frame themselves. Lines that were not redrawn
+     * keep what the buffer already holds, changing the buffer or format redraws every line
+     * 
+     * @param buffer 144 lines, aligned for the format's pixel type, nullptr to stop
+     * @param format pixel layout
+     * @param pitch bytes from one line to the next, 0 for PixelKernels::lineBytes(format)
+     */
+    void setOutput(void* buffer, PixelFormat format, int pitch = 0);
+
+    /**
+     * Colours the RGB565 and RGBA8888 outputs map shades 0-3 to, DMG greys by default
+     * 
+     * @param palette RGBA8888 colour per shade, red in the lowest byte
+     */
+    void setPalette(const uint32_t palette[4]);
+
+    /**
+     * Publishes each frame that changed to queue as VBlank starts, in the setOutput format or as
+     * 0-3 shades without one, so consumers on other threads always have a whole frame to read
+     * 
+     * @param queue frames of at least getFrameBytes(), nullptr to stop
+     * @return false if the queue's frames are too small, nothing is published then
+     */
+    bool setFrameQueue(FrameQueue* queue);
+
+    // bytes of a frame published to the frame queue
+    size_t getFrameBytes() const{
+        return output ? size_t(outputPitch) * 144 : sizeof(frameBuffer);
+    }
+
     bool isFrameReady() const{
         return frameReady;
     }
@@ -53,10 +115,68 @@ public:
     void clearNewFrameFlag(){
         frameReady = false;
     }
+
+    /**
+     * Whether the frame that just finished drew any pixels, the frame buffer still holds the last
+     * drawn frame otherwise
+     */
+    bool isFrameRendered() const{
+        return frameRendered;
+    }
+
+    /**
+     * Whether the frame that just finished redrew any line. The frame buffer is the same as
+     * after the previous frame otherwise, so consumers can skip converting or uploading it
+     */
+    bool isFrameChanged() const{
+        return frameChanged;
+    }
+
+    // frames to skip between drawn ones, skipped frames keep all timing and interrupts but draw no pixels
+    int frameSkip = 0;
+
+    // decides per frame instead of frameSkip when set, called with the number of the frame about to start
+    std::function<bool(uint64_t frame)> renderFrame;
+
+    /**
+     * How long until the PPU next changes mode, measured from where it was last caught up to.
+     * Mode 3 is measured without its object penalty, which can only make the answer early, never late
+     * 
+     * @return t states until the next mode change, at least 1, or -1 if the LCD is off
+     */
+    int cyclesUntilModeChange() const;
+
+    /**
+     * How long until the next mode change that requests an interrupt or finishes a frame, the
+     * only ones that matter to a program not reading PPU state. Measured like cyclesUntilModeChange()
+     * and just as early at worst
+     * 
+     * @return t states until that mode change, at least 1, or -1 if the LCD is off
+     */
+    int cyclesUntilInterrupt() const;
+
+    // schedule every mode change rather than only the ones that raise an interrupt, for A/B runs against the lazy model
+    bool eager = false;
 private:
     Bus& bus;
+    uint64_t lastSync = 0; // scheduler time the PPU has been run up to
+
+    /**
+     * Advance the PPU by tStates
+     * 
+     * @param tStates
+     */
+    void step(int tStates);
+
+    // schedules the next mode change that raises an interrupt, or a plain catch up a frame from now while the LCD is off
+    void reschedule();
 
     uint8_t vram[0x2000]; // 8KiB
+
+    // tile data 8000-97FF decoded to colour indices, kept in step with vram by write()
+    static constexpr int TILE_COUNT = 384;
+    uint8_t decodedTiles[TILE_COUNT][8][8]; // [tile][row][pixel], leftmost pixel first
+    uint8_t decodedTilesFlipped[TILE_COUNT][8][8]; // same rows mirrored for X flipped sprites
     uint8_t oam[0xA0]; // 160 bytes (40 sprites each 4 bytes)
 
     uint8_t LCDC; // LCD control FF40
@@ -96,42 +216,144 @@ private:
     }
 
     uint8_t frameBuffer[160*144];
+
+    // where setOutput asked for lines to go
+    uint8_t* output = nullptr;
+    PixelFormat outputFormat = PixelFormat::RGBA8888;
+    int outputPitch = 0;
+    uint32_t outputPalette[4] = {0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFF000000};
+    uint16_t outputPalette16[4] = {
+        PixelKernels::toRgb565(0xFFFFFFFF), PixelKernels::toRgb565(0xFFAAAAAA),
+        PixelKernels::toRgb565(0xFF555555), PixelKernels::toRgb565(0xFF000000)
+    };
+
+    // converts line LY of the frame buffer into the output
+    void outputLine();
+
+    FrameQueue* frameQueue = nullptr;
+    bool framePublished = false; // whether the queue has the frame as it is now, unchanged frames arent published again
+
+    // copies the finished frame into the queue
+    void publishFrame();
+
+    // forgets what every line was drawn from, so all of them are drawn again next frame
+    void invalidateLines();
     bool frameReady = false;
 
+    uint64_t frameNumber = 0; // frames started since power on, the first is always drawn
+    bool renderingFrame = true; // whether the current frame draws pixels
+    bool frameRendered = true; // whether the last finished frame did
+    bool frameChanging = false; // whether the current frame has redrawn any line so far
+    bool frameChanged = true; // whether the last finished frame did
+
+    // called as VBlank starts, records whether the frame was drawn and decides for the next one
+    void endFrame();
+
     int dotCounter = 0;
 
+    // a sprite in the order the fetcher reaches it and how long it stalls mode 3 for
+    struct ObjFetch{
+        uint8_t sprite; // index into scanlineSprites
+        int16_t x; // screen X of its leftmost pixel
+        uint8_t stall; // dots
+    };
+
     /**
      * Computes an objects penalty for mode 3 based on how many stalls occur when a new 
      * background tile must be fetched mid object
+     * 
+     * @param fetches if not null gets one entry per selected sprite, leftmost first
      */
-    int computeObjPenalty();
+    int computeObjPenalty(ObjFetch* fetches = nullptr);
+
+    int lastMode3Penalty = 0;
+    int lastMode3Length = 0; // dots, only kept by the FIFO
+
+    // mode 3 can't end sooner than this after it starts, the object penalty and for the FIFO the window are left out
+    int mode3MinimumLength() const;
 
-    int lastMode3Penalty;
+    // dots in mode 0 once mode 3 has ended
+    int hblankLength() const;
 
     void renderScanline();
 
+    /**
+     * Reads a background or window tile row from VRAM with the registers as they are now
+     * 
+     * @param window fetch from the window tile map
+     * @param tileCol tile map column, wraps at 32
+     * @param out 8 colour indices
+     */
+    void fetchTileRow(bool window, int tileCol, uint8_t* out) const;
+
     struct Sprite{
         uint8_t y, x, tileIndex, flags; 
+
+        bool operator==(const Sprite&) const = default;
     };
 
-    struct SpritePixel{
-        uint8_t colour; // 2 bit colour
-        bool bgPriority; // true if background has priority over this pixel
-        uint8_t palette; // 0 = use OBP0, 1 = use OBP1
+    /**
+     * Decoded row of a sprite on the current line, already X flipped if the sprite is
+     * 
+     * @param sprite the sprite
+     * @param attributes set to bit 2 OBP1 and bit 3 behind background, the layout composeLine takes
+     * @return 8 colour indices
+     */
+    const uint8_t* spriteRow(const Sprite& sprite, uint8_t& attributes) const;
+
+    // mode 3 state of the FIFO fidelity, reset as each line's mode 3 starts
+    struct PixelFifo{
+        int dot = 0; // dots of mode 3 run so far
+        int lcdX = 0; // next pixel to output
+        int discard = 0; // fine scroll pixels still to drop
+        int lineDiscard = 0; // fine scroll the line started with
+        int stall = 0; // dots left of a sprite fetch
+
+        uint8_t row[8] = {}; // background FIFO, the fetcher only pushes once it is empty
+        int rowPos = 0;
+        int rowLeft = 0;
+
+        uint8_t nextRow[8] = {}; // row the fetcher is holding until the FIFO empties
+        int fetchDots = 0; // dots into the current tile fetch, starts negative for the discarded first fetch
+        bool fetched = false;
+        int backgFetches = 0; // background tiles pushed so far, the column is worked out from SCX as each is fetched
+        bool inWindow = false;
+        int windowTileCol = 0;
+
+        ObjFetch fetches[10] = {};
+        int fetchCount = 0;
+        int nextFetch = 0;
+        uint8_t sprites[8] = {}; // sprite pixels by screen X % 8, composeLine layout
     };
+    PixelFifo fifo;
 
-    std::vector<Sprite> scanlineSprites;
+    void beginPixelTransfer();
+
+    // runs the FIFO up to dotCounter or the end of the line
+    void runPixelFifo();
+    void tickPixelFifo();
 
-    std::deque<uint8_t> backgroundFIFO; // background/window pixels
-    std::deque<SpritePixel> spriteFIFO; // sprite pixels
+    // everything a line's pixels depend on, lines whose inputs match the last time they were drawn are skipped
+    struct LineInputs{
+        uint32_t vramGeneration = 0;
+        std::array<uint8_t, 8> registers{}; // LCDC SCY SCX BGP OBP0 OBP1 WY WX
+        uint8_t spriteCount = 0;
+        std::array<Sprite, 10> sprites{};
+        bool valid = false; // false until the line has been drawn once
+
+        bool operator==(const LineInputs&) const = default;
+    };
+
+    LineInputs lineInputs[144];
+    uint32_t vramGeneration = 0; // bumped whenever a VRAM byte changes
+
+    std::vector<Sprite> scanlineSprites;
 
     // to clear when LCD turns off
     void disableLCD(){
         STAT = (STAT & ~ 0x03) | 0;
         LY = 0;
         dotCounter = 0;
-        backgroundFIFO.clear();
-        spriteFIFO.clear();
         frameReady = false;
     }
 
@@ -144,7 +366,7 @@ private:
     int oamDmaCycles = 0;
     uint16_t dmaSource = 0;
 
-    // called each cpu step to advance DMA 
+    // advances DMA along with the rest of the PPU
     void stepDma(int cycles){
         if(!oamDmaActive) return;
         oamDmaCycles -= cycles;
@@ -159,9 +381,39 @@ private:
         else return vram[index];
     }
 
+    // re decodes the tile row a tile data write landed in
+    inline void updateDecodedTile(uint16_t address){
+        size_t tile = (address - 0x8000) >> 4;
+        size_t row = (address >> 1) & 7;
+        size_t low = (address - 0x8000) & ~size_t(1);
+        uint8_t* pixels = decodedTiles[tile][row];
+        PixelKernels::get().decodeTileRow(vram[low], vram[low + 1], pixels);
+        for(int i = 0; i < 8; ++i){
+            decodedTilesFlipped[tile][row][i] = pixels[7 - i];
+        }
+    }
+
+    // decoded colour indices for the tile row starting at a tile data address
+    inline const uint8_t* decodedTileRow(uint16_t address, bool xFlip = false) const{
+        size_t tile = (address - 0x8000) >> 4;
+        size_t row = (address >> 1) & 7;
+        return xFlip ? decodedTilesFlipped[tile][row] : decodedTiles[tile][row];
+    }
+
     inline uint8_t oamReadRaw(uint16_t address) const{
         size_t index = address - 0xFE00;
         if(index >= sizeof(oam)) return 0xFF;
         else return oam[index];
     }
 };
+
+// both are built in ppu.cpp, so the one not picked for the emulator still compiles
+extern template class BasicPPU<PPUFidelity::SCANLINE>;
+extern template class BasicPPU<PPUFidelity::FIFO>;
+
+// picked with the GB_PPU_FIFO CMake option
+#ifdef GB_PPU_FIFO
+using PPU = BasicPPU<PPUFidelity::FIFO>;
+#else
+using PPU = BasicPPU<PPUFidelity::SCANLINE>;
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * Global clock in t states and the time each peripheral next needs to run. Peripherals work
+ * out when they next do something visible (raise an interrupt, change PPU mode, finish a DMA)
+ * and schedule it here, everything else about them is caught up lazily when their registers are
+ * accessed. Bus::step advances the clock and runs whatever came due
+ */
+class Scheduler{
+public:
+    // one pending deadline per event, scheduling one again replaces it
+    enum Event : uint8_t {
+        TIMER, // TIMA overflow
+        PPU, // PPU mode change
+        OAM_DMA, // OAM DMA finished
+        EVENT_COUNT
+    };
+
+    static constexpr uint64_t NEVER = UINT64_MAX;
+
+    // nothing lets its deadline drift further than this, one frame, so lazy catch ups stay small
+    static constexpr int MAX_EVENT_DISTANCE = 70224;
+
+    /**
+     * @return t states since power on
+     */
+    uint64_t getNow() const{
+        return now;
+    }
+
+    void advance(int tStates){
+        now += uint64_t(tStates);
+    }
+
+    /**
+     * Whether the earliest deadline has been reached
+     */
+    bool isDue() const{
+        return now >= earliest;
+    }
+
+    /**
+     * @return timestamp of the earliest deadline, NEVER if nothing is scheduled
+     */
+    uint64_t nextDeadline() const{
+        return earliest;
+    }
+
+    /**
+     * Sets when event next has to run
+     *
+     * @param event the event
+     * @param tStates t states from now, at least 1
+     */
+    void schedule(Event event, int tStates);
+
+    /**
+     * Forgets event's deadline
+     *
+     * @param event the event
+     */
+    void cancel(Event event);
+
+    /**
+     * Removes the earliest deadline, only call while isDue()
+     *
+     * @return the event it belonged to
+     */
+    Event popDue();
+private:
+    uint64_t now = 0;
+    uint64_t earliest = NEVER;
+    uint64_t deadlines[EVENT_COUNT] = {NEVER, NEVER, NEVER};
+
+    // with a handful of events a scan is cheaper than keeping a heap in order
+    void findEarliest();
+};
@@ -1,43 +1,77 @@
 #pragma once
 #include <cstdint>
 
-class CPU;
+class IO;
+class Scheduler;
+class InterruptController;
 
 class Timer{
 public:
-    Timer();
+    /**
+     * @param scheduler global clock the timer catches up to and schedules its overflow on
+     * @param interrupts where the timer interrupt is requested
+     */
+    Timer(Scheduler& scheduler, InterruptController& interrupts);
+
+    /**
+     * Applies the TIMA increments up to now and schedules the next overflow, called when
+     * Scheduler::TIMER is due
+     */
+    void onEvent();
 
     /**
-     * Advance timer by number of t states
+     * Attaches FF04-FF07 to the IO page
      * 
-     * @param tStates one tState = one CPU clock cycle, One machine cycle (M-cycle) is 4 T-states
-     * @param cpu reference to cpu used to request interupts
+     * @param io the IO page
      */
-    void step(int tStates, CPU& cpu);
+    void mapRegisters(IO& io);
 
     /**
-     * Reads the timer addresses FF04-FF07
+     * Reads the timer addresses FF04-FF07, DIV and TIMA are worked out for the current time
      * 
      * @param address the 16 bit address to read from
      * @return the byte stored at the corresponding timer register
      */
-    uint8_t read(uint16_t address) const;
+    uint8_t read(uint16_t address);
     /**
-     * Write to address FF04-FF07
+     * Write to address FF04-FF07, moves the scheduled overflow
      * 
      * @param address the 16 bit address to write to
      * @param byte the byte you are writing to the address
      */
     void write(uint16_t address, uint8_t byte);
+
+    /**
+     * How long until TIMA next overflows and requests the timer interrupt
+     * 
+     * @return t states until the overflow, at least 1, or -1 if the timer is stopped
+     */
+    int cyclesUntilInterrupt() const;
+
+    /**
+     * Number of register reads so far, they change without the timer raising an event
+     */
+    uint32_t getReadCount() const{
+        return readCount;
+    }
 private:
-    uint8_t DIV = 0; // Divider register FF04
+    Scheduler& scheduler;
+    InterruptController& interrupts;
+
+    /*
+     * DIV is the top byte of a 16 bit counter that goes up every t state, kept as the time it was
+     * last zero. TIMA goes up on each falling edge of one bit of that counter, picked by TAC, so
+     * it only has to be brought up to date when read, written or about to overflow
+     */
+    uint64_t counterOrigin = 0; // scheduler time the system counter was 0, may be before power on
+    uint64_t lastSync = 0; // scheduler time TIMA is up to date with
+
     uint8_t TIMA = 0; // Timer counter FF05
     uint8_t TMA = 0; // Timer modulo FF06
     uint8_t TAC = 0; // Timer control FF07
+    uint32_t readCount = 0;
 
-    int divCounter = 0; // accumulates t states for DIV
-    int timaCounter = 0; // accumulates t states for TIMA when enabled
-
+    // system counter period of the bit TIMA follows, one TIMA increment per period
     static constexpr int FREQUENCIES[4] = {
         1024, // 4096Hz 256 M-cycles
         16, // 262144Hz 4 M-cycles
@@ -49,4 +83,26 @@ private:
     static constexpr uint16_t TIMA_ADDRESS = 0xFF05;
     static constexpr uint16_t TMA_ADDRESS = 0xFF06;
     static constexpr uint16_t TAC_ADDRESS = 0xFF07;
+
+    // system counter at a scheduler time, without wrapping to 16 bits
+    uint64_t counterAt(uint64_t time) const{
+        return time - counterOrigin;
+    }
+
+    // the input TIMA counts falling edges of, the selected counter bit gated by the enable bit
+    bool timerSignal(uint64_t counter) const{
+        return (TAC & 0x04) && (counter & (FREQUENCIES[TAC & 0x03] / 2));
+    }
+
+    /**
+     * Adds increments to TIMA, reloading it from TMA and requesting the timer interrupt each
+     * time it overflows
+     */
+    void increment(uint64_t increments);
+
+    // applies every falling edge between lastSync and now
+    void catchUp();
+
+    // schedules the next overflow, cancels it while TIMA is stopped
+    void reschedule();
 };
\ No newline at end of file
@@ -0,0 +1,172 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// what a trace entry records
+enum class TraceEntryKind : uint8_t {
+    INSTRUCTION, // an executed instruction
+    DROPPED, // count entries were lost here because the writer fell behind
+    SKIPPED // count t states passed without running instructions (HALT, STOP, a skipped idle loop)
+};
+
+/**
+ * One executed instruction, registers are as they were before it ran. Written to trace files
+ * as is, so the layout is fixed
+ */
+struct TraceEntry{
+    uint64_t cycle; // t states since power on when the instruction started
+    uint16_t PC;
+    uint16_t SP;
+    uint16_t AF;
+    uint16_t BC;
+    uint16_t DE;
+    uint16_t HL;
+    uint8_t opcode;
+    uint8_t operands[2]; // only the ones the opcode has are meaningful
+    TraceEntryKind kind = TraceEntryKind::INSTRUCTION;
+
+    // entries other than instructions carry a count in place of AF, BC, DE and HL
+    uint64_t count() const{
+        return uint64_t(AF) | uint64_t(BC) << 16 | uint64_t(DE) << 32 | uint64_t(HL) << 48;
+    }
+    void setCount(uint64_t value){
+        AF = uint16_t(value);
+        BC = uint16_t(value >> 16);
+        DE = uint16_t(value >> 32);
+        HL = uint16_t(value >> 48);
+    }
+};
+
+static_assert(sizeof(TraceEntry) == 24, "trace files depend on the entry layout");
+
+// trace files start with this, then a TraceFileHeader, then up to capacity TraceEntry records
+inline constexpr char TRACE_FILE_MAGIC[8] = {'G', 'B', 'T', 'R', 'A', 'C', 'E', '2'};
+
+/**
+ * Follows the magic. The records form a circular file of capacity slots, entry number n goes
+ * in slot n % capacity, so once more than capacity entries were written the oldest one kept is
+ * in slot written % capacity and the file holds the newest capacity entries
+ */
+struct TraceFileHeader{
+    uint64_t capacity; // slots in the file
+    uint64_t written; // entries written since tracing started, the wrap point follows from it
+    uint64_t dropped; // entries the writer fell too far behind for, each loss is also marked in place
+};
+
+static_assert(sizeof(TraceFileHeader) == 24, "trace files depend on the header layout");
+
+/**
+ * Fixed size single producer single consumer ring of trace entries. The emulation thread
+ * pushes, a TraceWriter pops, neither side ever blocks or locks. When the writer falls behind
+ * new entries are dropped and counted rather than stalling emulation, and once there is room
+ * again a DROPPED entry saying how many went missing is recorded before the next one
+ */
+class TraceBuffer{
+public:
+    /**
+     * @param capacity number of entries, rounded up to a power of two
+     */
+    explicit TraceBuffer(size_t capacity);
+
+    /**
+     * Producer side, called by the cpu once per instruction
+     * 
+     * @param entry the instruction to record
+     */
+    void push(const TraceEntry& entry){
+        size_t position = head.load(std::memory_order_relaxed);
+        size_t free = entries.size() - (position - tail.load(std::memory_order_acquire));
+        // a loss needs a slot for its marker as well
+        if(free < (unreported ? 2u : 1u)){
+            unreported++;
+            dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); // only the producer writes it
+            return;
+        }
+        if(unreported){
+            TraceEntry& marker = entries[position++ & mask];
+            marker = entry;
+            marker.kind = TraceEntryKind::DROPPED;
+            marker.setCount(unreported);
+            unreported = 0;
+        }
+        entries[position & mask] = entry;
+        head.store(position + 1, std::memory_order_release);
+    }
+
+    /**
+     * Consumer side, copies out as many entries as are ready
+     * 
+     * @param out where to copy entries to
+     * @param maxEntries room in out
+     * @return number of entries copied
+     */
+    size_t pop(TraceEntry* out, size_t maxEntries);
+
+    /**
+     * Entries thrown away because the buffer was full
+     */
+    uint64_t getDropped() const{
+        return dropped.load(std::memory_order_relaxed);
+    }
+private:
+    std::vector<TraceEntry> entries;
+    size_t mask;
+    uint64_t unreported = 0; // dropped since the last marker, only the producer touches it
+
+    // on their own cache lines so the two threads dont fight over them
+    alignas(64) std::atomic<size_t> head{0}; // next slot to write, only the producer stores it
+    alignas(64) std::atomic<size_t> tail{0}; // next slot to read, only the consumer stores it
+    alignas(64) std::atomic<uint64_t> dropped{0};
+};
+
+/**
+ * Background thread that drains a TraceBuffer into a binary trace file, flushing after every
+ * batch so a crash only loses what was still in the buffer. The file never grows past
+ * maxEntries records, older ones are overwritten in place. tools/trace_decoder.cpp turns the
+ * file back into text
+ */
+class TraceWriter{
+public:
+    /**
+     * Opens the file and starts draining
+     * 
+     * @param buffer buffer the cpu records into
+     * @param path trace file to create, overwritten if it exists
+     * @param maxEntries most entries kept, only the newest ones once it is full
+     */
+    TraceWriter(TraceBuffer& buffer, const std::string& path, uint64_t maxEntries = DEFAULT_MAX_ENTRIES);
+
+    /**
+     * Drains whatever is left, then stops the thread and closes the file
+     */
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    bool isOpen() const{
+        return file.is_open();
+    }
+
+    // about 100MB of trace
+    static constexpr uint64_t DEFAULT_MAX_ENTRIES = 1 << 22;
+private:
+    TraceBuffer& buffer;
+    std::ofstream file;
+    TraceFileHeader header{};
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+
+    static constexpr size_t BATCH_ENTRIES = 4096;
+
+    void run();
+
+    // writes entries at the slots they belong in, wrapping to the first one past the end
+    void writeEntries(const TraceEntry* entries, size_t count);
+    void writeHeader();
+};
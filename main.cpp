@@ -2,8 +2,14 @@
 #include "cpu.h"
 #include "timer.h"
 #include "bus.h"
+#include "trace.h"
+#include "pixels.h"
+#include "framequeue.h"
 #include <iostream>
 #include <string>
+#include <memory>
+#include <algorithm>
+#include <cstdlib>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_opengl.h>
 #include <imgui.h>
@@ -21,7 +27,7 @@ bool gKeyState[8] = {false,false,false,false, false,false,false,false};
 int main(int argc, char* argv[]){
 
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <path-to-rom.gb>\n";
+        std::cerr << "Usage: " << argv[0] << " <path-to-rom.gb> [--backend=switch|table|cache|jit] [--no-idle-skip] [--accurate-timing] [--eager-ppu] [--simd=scalar|sse2|avx2] [--frame-skip=N] [--rgb565] [--trace=<file>] [--trace-limit=N]\n";
         return 1;
     }
 
@@ -71,13 +77,60 @@ int main(int argc, char* argv[]){
     Bus bus(cart);
     CPU cpu(bus);
 
+    std::string tracePath;
+    uint64_t traceLimit = TraceWriter::DEFAULT_MAX_ENTRIES;
+    bool rgb565 = false;
+    for(int i = 2; i < argc; ++i){
+        const std::string arg = argv[i];
+        // table is the default, the reference switch and the opt in block cache are there for comparison
+        if(arg == "--backend=switch") cpu.backend = CPU::Backend::SWITCH;
+        else if(arg == "--backend=table") cpu.backend = CPU::Backend::TABLE;
+        else if(arg == "--backend=cache") cpu.backend = CPU::Backend::BLOCK_CACHE;
+        else if(arg == "--backend=jit") cpu.backend = CPU::Backend::JIT;
+        else if(arg == "--no-idle-skip") cpu.idleLoopSkipping = false;
+        else if(arg == "--accurate-timing") cpu.accurateTiming = true;
+        else if(arg == "--eager-ppu") bus.ppu.eager = true;
+        else if(arg.rfind("--trace=", 0) == 0) tracePath = arg.substr(8);
+        // only the newest N instructions are kept in the trace file
+        else if(arg.rfind("--trace-limit=", 0) == 0) traceLimit = std::strtoull(arg.c_str() + 14, nullptr, 10);
+        else if(arg.rfind("--frame-skip=", 0) == 0) bus.ppu.frameSkip = std::max(0, std::atoi(arg.c_str() + 13));
+        else if(arg == "--rgb565") rgb565 = true; // half the bytes per uploaded frame
+        // pixel kernels are picked from the cpu's features, these force a lower level for comparison
+        else if(arg == "--simd=scalar") PixelKernels::select(PixelKernels::Level::SCALAR);
+        else if(arg == "--simd=sse2") PixelKernels::select(PixelKernels::Level::SSE2);
+        else if(arg == "--simd=avx2") PixelKernels::select(PixelKernels::Level::AVX2);
+    }
+
+    // a million instructions of slack for the writer thread, it normally keeps up easily
+    std::unique_ptr<TraceBuffer> traceBuffer;
+    std::unique_ptr<TraceWriter> traceWriter;
+    if(!tracePath.empty()){
+        traceBuffer = std::make_unique<TraceBuffer>(1 << 20);
+        traceWriter = std::make_unique<TraceWriter>(*traceBuffer, tracePath, traceLimit);
+        if(!traceWriter->isOpen()){
+            std::cerr << "Failed to open trace file " << tracePath << std::endl;
+            return 1;
+        }
+        cpu.trace = traceBuffer.get();
+    }
+
     GLuint gbTexture = 0;
+    // the PPU writes each line it draws straight in here in the texture's format
     std::vector<uint32_t> gpuFrame(160 * 144);
+    const GLenum uploadFormat = rgb565 ? GL_RGB : GL_RGBA;
+    const GLenum uploadType = rgb565 ? GL_UNSIGNED_SHORT_5_6_5 : GL_UNSIGNED_BYTE;
+    bus.ppu.setPalette(dmgPalette);
+    bus.ppu.setOutput(gpuFrame.data(), rgb565 ? PixelFormat::RGB565 : PixelFormat::RGBA8888);
+
+    // finished frames are uploaded from here, which doesnt care which thread runs the emulator
+    FrameQueue frames(bus.ppu.getFrameBytes());
+    bus.ppu.setFrameQueue(&frames);
+    uint64_t uploadedFrame = UINT64_MAX;
 
     glGenTextures(1, &gbTexture);
     glBindTexture(GL_TEXTURE_2D, gbTexture);
-    // allocate empty RGBA buffer for 160×144
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,160, 144, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    // allocate empty buffer for 160×144
+    glTexImage2D(GL_TEXTURE_2D, 0, uploadFormat, 160, 144, 0, uploadFormat, uploadType, nullptr);
     // nearest neighbor scaling so pixels stay sharp
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -115,28 +168,28 @@ int main(int argc, char* argv[]){
         ImGui_ImplSDL2_NewFrame(window);
         ImGui::NewFrame();
 
-        // run until vblank
-        while (!bus.ppu.isFrameReady()) {
-            int m = cpu.step();
-            bus.step(m * 4, cpu);
+        // run until vblank, with frame skip on the skipped frames run here too so it fast forwards
+        uint64_t idleCyclesBefore = cpu.idleCyclesSkipped;
+        int emulatedFrames = bus.ppu.frameSkip + 1;
+        for(int frame = 0; frame < emulatedFrames; ++frame){
+            cpu.runUntilFrame();
+            bus.ppu.clearNewFrameFlag();
         }
-        bus.ppu.clearNewFrameFlag();
-
-        // Grab the 0-3 indices from the PPU
-        const uint8_t* indexBuffer = bus.ppu.getFrameBuffer();
-
-        // Expand into a uint32_t RGBA buffer
-        for (int i = 0; i < 160*144; i++) {
-            gpuFrame[i] = dmgPalette[indexBuffer[i] & 3];
+        uint64_t idleCyclesThisFrame = (cpu.idleCyclesSkipped - idleCyclesBefore) / uint64_t(emulatedFrames);
+
+        // skipped frames and frames that redrew no line arent published, no need to upload the same one again
+        FrameQueue::Frame frame = frames.acquire();
+        if(frame && frame.number() != uploadedFrame){
+            // upload the 160×144 image, already converted line by line as the PPU drew it
+            glBindTexture(GL_TEXTURE_2D, gbTexture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0,
+                            0, 0, 160, 144,
+                            uploadFormat, uploadType,
+                            reinterpret_cast<const GLvoid*>(frame.data()));
+            glBindTexture(GL_TEXTURE_2D, 0);
+            uploadedFrame = frame.number();
         }
-
-        // upload the 160×144×4 byte RGBA image
-        glBindTexture(GL_TEXTURE_2D, gbTexture);
-        glTexSubImage2D(GL_TEXTURE_2D, 0,
-                        0, 0, 160, 144,
-                        GL_RGBA, GL_UNSIGNED_BYTE,
-                        reinterpret_cast<const GLvoid*>(gpuFrame.data()));
-        glBindTexture(GL_TEXTURE_2D, 0);
+        frame.release();
 
         // draw within ImGui
         ImGui::Begin("Game Boy Screen");
@@ -144,6 +197,12 @@ int main(int argc, char* argv[]){
                      ImVec2(160 * 2.0f, 144 * 2.0f));
         ImGui::End();
 
+        // a frame is 17556 M cycles, shows how much of it idle loop skipping saved
+        ImGui::Begin("Stats");
+        ImGui::Text("Idle M cycles skipped: %llu / frame", (unsigned long long)idleCyclesThisFrame);
+        ImGui::SliderInt("Frame skip", &bus.ppu.frameSkip, 0, 9); // frames run but not drawn per shown frame
+        ImGui::End();
+
         // render ImGui to OpenGL
         ImGui::Render();
         int w, h;
@@ -158,6 +217,13 @@ int main(int argc, char* argv[]){
     }
 
     // cleanup
+    if(traceWriter){
+        cpu.trace = nullptr;
+        traceWriter.reset(); // drains what is left and finishes the file
+        if(uint64_t dropped = traceBuffer->getDropped()){
+            std::cerr << "Trace dropped " << dropped << " entries, the writer could not keep up" << std::endl;
+        }
+    }
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
@@ -0,0 +1,99 @@
+#include "blockcache.h"
+#include "bus.h"
+#include "opcodes.h"
+
+// true for anything that can move PC somewhere other than the next instruction, or stops the cpu
+static constexpr bool endsBlock(uint8_t opcode){
+    switch(opcode){
+        case 0x10: case 0x76: // STOP, HALT
+        case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+        case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: case 0xE9: // JP
+        case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC: // CALL
+        case 0xC0: case 0xC8: case 0xC9: case 0xD0: case 0xD8: case 0xD9: // RET, RETI
+        case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: // RST
+            return true;
+        default:
+            // illegal opcodes lock up real hardware, let the interpreter deal with them
+            return OPCODES[opcode].cycles == 0 && opcode != 0xCB;
+    }
+}
+
+BlockCache::BlockCache(Bus& bus) : bus(bus){}
+
+BasicBlock* BlockCache::enter(uint16_t pc){
+    current = nullptr;
+    if(pc >= 0x8000){
+        // code running from VRAM, WRAM or HRAM can change under us so it always goes through the bus
+        return nullptr;
+    }
+
+    if(!regions[0] || mappedSwitchCount != bus.bankSwitchCount()){
+        mapRegions();
+    }
+
+    BasicBlock*& entry = regions[pc >> 14][pc & 0x3FFF];
+    if(!entry){
+        entry = &decode(pc, bus.romBankAt(pc));
+    }
+
+    BasicBlock& block = *entry;
+    if(block.count == 0) return nullptr;
+
+    current = &block;
+    cursor = 0;
+    nextPC = pc;
+    return &block;
+}
+
+void BlockCache::mapRegions(){
+    mappedSwitchCount = bus.bankSwitchCount();
+    for(int region = 0; region < 2; ++region){
+        uint16_t bank = bus.romBankAt(uint16_t(region * 0x4000));
+        if(bank >= bankIndex.size()){
+            bankIndex.resize(bank + 1);
+        }
+        if(!bankIndex[bank]){
+            bankIndex[bank] = std::make_unique<BasicBlock*[]>(0x4000); // value initialised, all nullptr
+        }
+        regions[region] = bankIndex[bank].get();
+    }
+}
+
+void BlockCache::clear(){
+    current = nullptr;
+    blocks.clear();
+    bankIndex.clear();
+    regions[0] = regions[1] = nullptr;
+}
+
+BasicBlock& BlockCache::decode(uint16_t pc, uint16_t bank){
+    BasicBlock& block = blocks.emplace_back();
+    block.startPC = pc;
+    block.bank = bank;
+    blocksDecoded++;
+
+    // blocks never leave the 16KiB region they start in, the next region may be mapped to another bank
+    uint32_t regionEnd = (uint32_t(pc) | 0x3FFF) + 1;
+    uint32_t address = pc;
+
+    while(block.count < BasicBlock::MAX_INSTRUCTIONS){
+        uint8_t opcode = bus.read(uint16_t(address));
+        uint8_t length = OPCODES[opcode].length;
+        if(address + length > regionEnd) break; // operands straddle the region boundary
+
+        DecodedInstruction& instruction = block.instructions[block.count++];
+        instruction.opcode = opcode;
+        instruction.length = length;
+        instruction.operands[0] = length > 1 ? bus.read(uint16_t(address + 1)) : 0;
+        instruction.operands[1] = length > 2 ? bus.read(uint16_t(address + 2)) : 0;
+
+        // conditional branches are budgeted at their not taken cost
+        instruction.cycles = opcode == 0xCB ? cbOpcodeCycles(instruction.operands[0]) : OPCODES[opcode].cycles;
+        block.cycles += instruction.cycles;
+
+        address += length;
+        if(endsBlock(opcode) || address >= regionEnd) break;
+    }
+
+    return block;
+}
@@ -97,6 +97,7 @@ bool Cartridge::loadRom(const std::string& romPath){
     this->currentRamBank = 0;
     this->ramEnabled = false;
     this->bankingMode = 0;
+    this->bankSwitchCount++;
 
     std::cout << "ROM loaded sucessfully" << std::endl;
 
@@ -113,6 +114,7 @@ void Cartridge::unloadRom(){
     this->currentRamBank = 0;
     this->ramEnabled = false;
     this->bankingMode = 0;
+    this->bankSwitchCount++;
 }
 
 uint8_t Cartridge::readByte(uint16_t address){
@@ -188,6 +190,43 @@ uint8_t Cartridge::readByte(uint16_t address){
 
 }
 
+uint16_t Cartridge::romBankAt(uint16_t address) const{
+    if(isMbc1){
+        return address < 0x4000 ? effectiveFixedBank() : effectiveSwitchBank();
+    }
+    if(isMbc2){
+        return address < 0x4000 ? 0 : currentRomBank;
+    }
+    if(isMbc3){
+        uint8_t bank = mbc3RomBank & 0x7F;
+        return address < 0x4000 ? 0 : (bank == 0 ? 1 : bank);
+    }
+    // no banking, 32KiB rom split into two fixed halves
+    return address < 0x4000 ? 0 : 1;
+}
+
+const uint8_t* Cartridge::romBankData(uint16_t address) const{
+    size_t index = size_t(romBankAt(address)) * 0x4000;
+    if(index + 0x4000 > romData.size()) return nullptr;
+    return romData.data() + index;
+}
+
+uint8_t* Cartridge::ramBankData(){
+    size_t index = 0;
+    if(isMbc1){
+        if(!ramEnabled) return nullptr;
+        index = size_t(currentRamBank) * 0x2000;
+    }else if(isMbc3){
+        if(!mbc3RamRtcEnable || mbc3RtcSel > 0x03) return nullptr;
+        index = size_t(mbc3RamBank & 0x03) * 0x2000;
+    }else{
+        // MBC2 RAM is 4 bits wide and unbanked carts never enable theirs
+        return nullptr;
+    }
+    if(index + 0x2000 > ramData.size()) return nullptr;
+    return ramData.data() + index;
+}
+
 bool Cartridge::writeByte(uint16_t address, uint8_t byte){
     // Mbc1
     if(isMbc1){
@@ -203,6 +242,7 @@ bool Cartridge::writeByte(uint16_t address, uint8_t byte){
             }
             // preserve any bits in 7,6,5 (0xE0=11100000) then or brings in the lower 5 bits
             currentRomBank = (currentRomBank & 0xE0) | newBank;
+            bankSwitchCount++;
             return true;
         }else if(address < 0x6000){
             // ram bank number 2 bit reg controlled by banking mode
@@ -213,9 +253,11 @@ bool Cartridge::writeByte(uint16_t address, uint8_t byte){
             }else{
                 currentRamBank = twoBits;
             }
+            bankSwitchCount++; // either half of rom can move depending on mode
             return true;
         }else if(address < 0x8000){
             bankingMode = byte & 0x01; // low bit determines banking mode
+            bankSwitchCount++;
             return true;
         }else if(address >= 0xA000 && address < 0xC000 && ramEnabled){
             size_t index = this->currentRamBank * 0x2000 + (address - 0xA000);
@@ -239,6 +281,7 @@ bool Cartridge::writeByte(uint16_t address, uint8_t byte){
             // rom bank
             uint8_t bank = byte & 0x0F;
             this->currentRomBank = (bank == 0 ? 1 : bank);
+            bankSwitchCount++;
             return true;
         }else if(address >= 0xA000 && address < 0xA200 && ramEnabled){
             // ram write
@@ -258,6 +301,7 @@ bool Cartridge::writeByte(uint16_t address, uint8_t byte){
             // rom bank 7 bits
             mbc3RomBank = (byte & 0x7F);
             if (mbc3RomBank == 0) mbc3RomBank = 1;
+            bankSwitchCount++;
             return true;
         } else if (address < 0x6000) {
             // ram bank (0-3) or rtc register select (0x08-0x0C)
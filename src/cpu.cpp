@@ -1,7 +1,13 @@
 #include "cpu.h"
 #include "instructions.h"
+#include "dispatch.h"
+#include "trace.h"
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <iterator>
 
-CPU::CPU(Bus& bus) : bus(bus), A(0x01), F(0xB0), B(0), C(0x13), D(0), E(0xD8), H(0x01), L(0x4D), SP(0xFFFE), PC(0x0100){
+CPU::CPU(Bus& bus) : bus(bus), blockCache(bus), jit(*this), A(0x01), B(0), C(0x13), D(0), E(0xD8), H(0x01), L(0x4D), SP(0xFFFE), PC(0x0100), F(0xB0){
     bus.write(INTERRUPT_FLAG_ADDRESS, 0xE1);
     bus.write(INTERRUPT_ENABLE_ADDRESS, 0x00);
 }
@@ -14,53 +20,187 @@ int CPU::step(){
 
     // STOP
     if(stopped){
-        uint8_t interruptRequest = bus.read(INTERRUPT_ENABLE_ADDRESS) & bus.read(INTERRUPT_FLAG_ADDRESS);
-        if(interruptRequest & (1 << JOYPAD)){
+        if(bus.interrupts.getPending() & (1 << JOYPAD)){
             // if joypad requests interupt terminate "stop"
             stopped = false;
+            return 1;
         }
-        return 1;
+        // only the joypad can end STOP and it is polled between frames, skip to the next event
+        return trace ? traceSkip(bus.cyclesUntilNextEvent()) : bus.cyclesUntilNextEvent();
     }
 
     // HALT
     if(halted){
-        uint8_t interruptRequest = bus.read(INTERRUPT_ENABLE_ADDRESS) & bus.read(INTERRUPT_FLAG_ADDRESS);
-        if(interruptRequest){
+        if(bus.interrupts.hasPending()){
             // if any sort of interupt then terminate "halt"
             halted = false;
+            return 1;
         }
-        return 1;
+        // nothing can wake the cpu before the next timer or PPU event, skip straight to it
+        return trace ? traceSkip(bus.cyclesUntilNextEvent()) : bus.cyclesUntilNextEvent();
     }
 
-    uint8_t ieaValue = bus.read(INTERRUPT_ENABLE_ADDRESS);
-    uint8_t ifaValue = bus.read(INTERRUPT_FLAG_ADDRESS);
-    uint8_t interruptRequest = ieaValue & ifaValue;
-    if(IME && interruptRequest){
-        // if IME is enable and there are any interupt requests
-        int src = 0;
-        while ((interruptRequest & (1 << src)) == 0) {
-            // interupt priority goes from VBLANK->JOYPAD, so service them one at a time in this order
-            ++src;
-        }
+    if(IME && bus.interrupts.hasPending()){
+        // interupt priority goes from VBLANK->JOYPAD, so service the lowest bit first
+        int src = std::countr_zero(bus.interrupts.getPending());
         // clear request
-        bus.write(INTERRUPT_FLAG_ADDRESS, ifaValue & ~(1 << src));
+        bus.interrupts.acknowledge(uint8_t(src));
         IME = false;
 
-        // push return address
-        pushToStack16(*this, bus, PC);
+        // push return address, after two wait states (push adds the second)
+        beginInstruction();
+        internalCycle();
+        pushToStack16(*this, PC);
         // jump to interupt sources which start at 0x40
         PC = INTERRUPT_SOURCE_ADDRESS + src*8; // each address is 8 bits
-        return 5; // 5 M-cycles
+        return endInstruction(5); // 5 M-cycles
+
+    }
+
+    uint16_t previousPC = lastPC;
+    lastPC = PC;
+    if(idleLoopSkipping && PC <= previousPC && previousPC - PC <= IDLE_LOOP_MAX_BYTES){
+        if(int skipped = skipIdleLoop(previousPC)){
+            return trace ? traceSkip(skipped) : skipped;
+        }
+    }
+
+    if(backend == Backend::JIT && !trace && !accurateTiming && !bus.ppu.isOamDmaActive() && !blockCache.continues(PC)){
+        if(BasicBlock* block = blockCache.enter(PC)){
+            if(!block->compiled && ++block->executions >= Jit::HOT_THRESHOLD){
+                jit.compile(*block);
+            }
+            // native runs only step the bus at handlers and the exit, so only enter a block that
+            // finishes before the next event, taken branches cost at most one cycle more
+            if(block->compiled && bus.getElapsed() + uint64_t(block->cycles + 4) * 4 < bus.scheduler.nextDeadline()){
+                blockCache.leave();
+                return jit.run(*block);
+            }
+        }
+    }
 
+    if(backend == Backend::BLOCK_CACHE || backend == Backend::JIT){
+        if(const DecodedInstruction* instruction = blockCache.fetch(PC)){
+            if(trace) traceInstruction(PC, instruction->opcode, instruction->operands);
+            PC++;
+            operands = instruction->operands;
+            beginInstruction();
+            int cycles = opcodeTable[instruction->opcode](*this, bus);
+            operands = nullptr;
+            return endInstruction(cycles);
+        }
     }
 
+    // the opcode fetch overlaps the end of the previous instruction, so it isnt counted as an access
     uint8_t opcode = bus.read(PC++);
+    if(trace) traceInstruction(uint16_t(PC - 1), opcode, nullptr);
+    beginInstruction();
+
+    if(backend != Backend::SWITCH){
+        return endInstruction(opcodeTable[opcode](*this, bus));
+    }
+    return endInstruction(decodeAndExecute(*this, bus, opcode));
+}
+
+int CPU::runFor(int cycles){
+    return run(cycles, false);
+}
+
+void CPU::runUntilFrame(){
+    run(INT_MAX, true);
+}
+
+int CPU::run(int cycles, bool untilFrame){
+    uint64_t start = bus.getElapsed();
+    uint64_t end = start + uint64_t(cycles) * 4;
+
+    while(!(untilFrame && bus.ppu.isFrameReady())){
+        bus.step(step() * 4);
+        if(bus.getElapsed() >= end) break;
+    }
+
+    return int((bus.getElapsed() - start) / 4);
+}
+
+int CPU::skipIdleLoop(uint16_t branch){
+    IdleLoop now;
+    now.head = PC;
+    now.branch = branch;
+    now.registers[0] = AF();
+    now.registers[1] = BC();
+    now.registers[2] = DE();
+    now.registers[3] = HL();
+    now.registers[4] = SP;
+    now.IME = IME;
+    now.imeEnabledNextStep = imeEnabledNextStep;
+    now.writeCount = bus.getWriteCount();
+    now.timerReadCount = bus.getTimerReadCount();
+    now.elapsed = bus.getElapsed();
+    // the event or mode change lands in its last M cycle, everything before that is quiet
+    int untilEvent = bus.cyclesUntilStateChange();
+    now.quietUntil = now.elapsed + uint64_t(untilEvent - 1) * 4;
+
+    // timer registers tick without raising an event and DMA ends without one, so neither can be skipped over
+    bool repeated = now.head == idleLoop.head && now.branch == idleLoop.branch
+                 && now.elapsed <= idleLoop.quietUntil // memory the last iteration read hasnt changed since
+                 && std::equal(std::begin(now.registers), std::end(now.registers), std::begin(idleLoop.registers))
+                 && now.IME == idleLoop.IME && now.imeEnabledNextStep == idleLoop.imeEnabledNextStep
+                 && now.writeCount == idleLoop.writeCount && now.timerReadCount == idleLoop.timerReadCount
+                 && !bus.ppu.isOamDmaActive();
+    uint64_t length = (now.elapsed - idleLoop.elapsed) / 4; // M cycles per iteration
+    idleLoop = now;
+    if(!repeated || length == 0){
+        return 0;
+    }
+
+    // every skipped iteration must finish before the event
+    uint64_t iterations = uint64_t(untilEvent - 1) / length;
+    if(iterations == 0){
+        return 0;
+    }
+
+    int skipped = int(iterations * length);
+    idleCyclesSkipped += skipped;
+    // the next step starts at the head again, make it look like the loop just jumped back
+    idleLoop.elapsed += uint64_t(skipped) * 4;
+    lastPC = branch;
+    return skipped;
+}
+
+void CPU::traceInstruction(uint16_t pc, uint8_t opcode, const uint8_t* operands){
+    TraceEntry entry;
+    entry.cycle = bus.getElapsed();
+    entry.PC = pc;
+    entry.SP = SP;
+    entry.AF = AF();
+    entry.BC = BC();
+    entry.DE = DE();
+    entry.HL = HL();
+    entry.opcode = opcode;
+    if(operands){
+        entry.operands[0] = operands[0];
+        entry.operands[1] = operands[1];
+    }else{
+        // readDuringDMA has no side effects, unlike a cpu read of an IO register
+        entry.operands[0] = bus.readDuringDMA(uint16_t(pc + 1));
+        entry.operands[1] = bus.readDuringDMA(uint16_t(pc + 2));
+    }
+    trace->push(entry);
+}
 
-    return decodeAndExecute(*this, bus, opcode);
+int CPU::traceSkip(int cycles){
+    TraceEntry entry;
+    entry.cycle = bus.getElapsed();
+    entry.PC = PC;
+    entry.SP = SP;
+    entry.opcode = 0;
+    entry.operands[0] = entry.operands[1] = 0;
+    entry.kind = TraceEntryKind::SKIPPED;
+    entry.setCount(uint64_t(cycles) * 4);
+    trace->push(entry);
+    return cycles;
 }
 
 void CPU::requestInterrupt(Interrupt interruptSource){
-    uint8_t flag = bus.read(INTERRUPT_FLAG_ADDRESS);
-    flag |= (1 << static_cast<uint8_t>(interruptSource));
-    bus.write(INTERRUPT_FLAG_ADDRESS, flag);
+    bus.interrupts.request(interruptSource);
 }
\ No newline at end of file
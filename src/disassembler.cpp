@@ -0,0 +1,63 @@
+#include "disassembler.h"
+#include "opcodes.h"
+#include <cstdio>
+
+// text for the immediate that replaces the placeholder in a mnemonic
+static std::string formatOperand(Operand operand, const uint8_t* bytes, uint16_t address){
+    char text[16];
+    switch(operand){
+        case Operand::D8:
+            std::snprintf(text, sizeof(text), "$%02X", bytes[1]);
+            break;
+        case Operand::D16:
+        case Operand::A16:
+            std::snprintf(text, sizeof(text), "$%04X", bytes[1] | (bytes[2] << 8));
+            break;
+        case Operand::A8:
+            std::snprintf(text, sizeof(text), "$FF%02X", bytes[1]);
+            break;
+        case Operand::R8: // relative to the instruction after the jump
+            std::snprintf(text, sizeof(text), "$%04X", uint16_t(address + 2 + int8_t(bytes[1])));
+            break;
+        case Operand::S8:
+            std::snprintf(text, sizeof(text), "%d", int(int8_t(bytes[1])));
+            break;
+        default:
+            return "";
+    }
+    return text;
+}
+
+std::string disassemble(const uint8_t* bytes, uint16_t address){
+    uint8_t opcode = bytes[0];
+
+    if(opcode == 0xCB){
+        uint8_t cbOpcode = bytes[1];
+        uint8_t x = cbOpcode >> 6;
+        uint8_t y = (cbOpcode >> 3) & 0x07;
+        const char* reg = OPERAND_NAMES[cbOpcode & 0x07];
+        if(x == 0) return std::string(CB_OPERATIONS[y]) + " " + reg;
+
+        static constexpr const char* BIT_OPERATIONS[4] = {"", "BIT", "RES", "SET"};
+        return std::string(BIT_OPERATIONS[x]) + " " + char('0' + y) + ", " + reg;
+    }
+
+    const OpcodeInfo& info = OPCODES[opcode];
+    if(info.cycles == 0){
+        char text[16];
+        std::snprintf(text, sizeof(text), "DB $%02X", opcode); // illegal, just show the byte
+        return text;
+    }
+
+    std::string text = info.mnemonic;
+    if(info.operand == Operand::NONE) return text;
+
+    // placeholders are named after the operand kind, d8 d16 a8 a16 r8 s8
+    static constexpr const char* PLACEHOLDERS[] = {"", "d8", "d16", "a8", "a16", "r8", "s8"};
+    const char* placeholder = PLACEHOLDERS[static_cast<int>(info.operand)];
+    size_t at = text.find(placeholder);
+    if(at != std::string::npos){
+        text.replace(at, std::char_traits<char>::length(placeholder), formatOperand(info.operand, bytes, address));
+    }
+    return text;
+}
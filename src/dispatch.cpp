@@ -0,0 +1,34 @@
+#include "dispatch.h"
+#include "instructions.h"
+#include <utility>
+
+template<uint8_t OPCODE>
+int executeOpcode(CPU& cpu, Bus& bus){
+    if constexpr(isRegisterForm(OPCODE)) return executeRegisterForm<OPCODE>(cpu);
+    else return decodeAndExecute(cpu, bus, OPCODE);
+}
+
+// CB prefix, fetch the second byte and dispatch through the CB table instead of the CB switch
+template<>
+int executeOpcode<0xCB>(CPU& cpu, Bus& bus){
+    uint8_t cbOpcode = cpu.fetch();
+    return cbOpcodeTable[cbOpcode](cpu, bus);
+}
+
+template<uint8_t CB_OPCODE>
+int executeCBOpcode(CPU& cpu, Bus&){
+    return executeCBForm<CB_OPCODE>(cpu);
+}
+
+template<size_t... I>
+constexpr auto makeOpcodeTable(std::index_sequence<I...>){
+    return std::to_array<OpcodeHandler>({&executeOpcode<uint8_t(I)>...});
+}
+
+template<size_t... I>
+constexpr auto makeCBOpcodeTable(std::index_sequence<I...>){
+    return std::to_array<OpcodeHandler>({&executeCBOpcode<uint8_t(I)>...});
+}
+
+const std::array<OpcodeHandler, 256> opcodeTable = makeOpcodeTable(std::make_index_sequence<256>{});
+const std::array<OpcodeHandler, 256> cbOpcodeTable = makeCBOpcodeTable(std::make_index_sequence<256>{});
@@ -0,0 +1,64 @@
+#include "framequeue.h"
+#include <utility>
+
+FrameQueue::FrameQueue(size_t frameBytes, int consumers) : frameBytes(frameBytes), slotCount(consumers + 2),
+                                                           slots(new Slot[consumers + 2]),
+                                                           storage(frameBytes * size_t(consumers + 2)){}
+
+void FrameQueue::publish(uint64_t number){
+    slots[writeSlot].number = number;
+    // the index store and the readers loads below pair with the increment and check in acquire(),
+    // both need to be sequentially consistent so one side always sees the other
+    latest.store(writeSlot);
+    published.fetch_add(1, std::memory_order_relaxed);
+
+    // every consumer holds at most one slot and the latest is another, so one is always free
+    for(int slot = (writeSlot + 1) % slotCount; ; slot = (slot + 1) % slotCount){
+        if(slot != writeSlot && slots[slot].readers.load() == 0){
+            writeSlot = slot;
+            return;
+        }
+    }
+}
+
+FrameQueue::Frame FrameQueue::acquire(){
+    while(true){
+        int slot = latest.load();
+        if(slot < 0) return {};
+        slots[slot].readers.fetch_add(1);
+        // the producer only starts on slots that are not the latest, so if this one still is after
+        // claiming it, it is complete and wont be written until released
+        if(latest.load() == slot) return Frame(this, slot);
+        slots[slot].readers.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+FrameQueue::Frame::Frame(Frame&& other) noexcept : queue(std::exchange(other.queue, nullptr)), slot(other.slot){}
+
+FrameQueue::Frame& FrameQueue::Frame::operator=(Frame&& other) noexcept{
+    if(this != &other){
+        release();
+        queue = std::exchange(other.queue, nullptr);
+        slot = other.slot;
+    }
+    return *this;
+}
+
+FrameQueue::Frame::~Frame(){
+    release();
+}
+
+const uint8_t* FrameQueue::Frame::data() const{
+    return queue->storage.data() + size_t(slot) * queue->frameBytes;
+}
+
+uint64_t FrameQueue::Frame::number() const{
+    return queue->slots[slot].number;
+}
+
+void FrameQueue::Frame::release(){
+    if(!queue) return;
+    // reads of the frame happen before the producer can see the slot free
+    queue->slots[slot].readers.fetch_sub(1, std::memory_order_release);
+    queue = nullptr;
+}
@@ -0,0 +1,7 @@
+#include "interrupts.h"
+#include "io.h"
+
+void InterruptController::mapRegisters(IO& io){
+    io.attach(IF_ADDRESS, IF_ADDRESS, *this);
+    io.setMasks(IF_ADDRESS, 0xE0, 0x1F);
+}
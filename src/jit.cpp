@@ -0,0 +1,381 @@
+#include "jit.h"
+#include "cpu.h"
+#include "dispatch.h"
+#include "opcodes.h"
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define GB_JIT_X64 1
+#include <sys/mman.h>
+#endif
+
+namespace{
+
+// x86 condition codes for jcc rel8, 0x70 + code
+enum Condition : uint8_t {
+    BELOW = 0x2, // carry set
+    NOT_BELOW = 0x3,
+    EQUAL = 0x4, // zero set
+    NOT_EQUAL = 0x5
+};
+
+// small x86-64 assembler, only what the block templates need. Memory operands are always
+// [rbx+disp32], rbx holds the CPU pointer for the whole block
+class Emitter{
+public:
+    std::vector<uint8_t> bytes;
+
+    void byte(uint8_t b){ bytes.push_back(b); }
+    void imm16(uint16_t v){ byte(uint8_t(v)); byte(uint8_t(v >> 8)); }
+    void imm32(uint32_t v){ for(int i = 0; i < 4; ++i) byte(uint8_t(v >> (i * 8))); }
+    void imm64(uint64_t v){ for(int i = 0; i < 8; ++i) byte(uint8_t(v >> (i * 8))); }
+
+    // opcode, then modrm for [rbx+disp32] with reg as the register or opcode extension
+    void rbxOperand(uint8_t opcode, uint8_t reg, uint32_t disp){ byte(opcode); byte(uint8_t(0x83 | (reg << 3))); imm32(disp); }
+
+    void pushRbx(){ byte(0x53); }
+    void popRbx(){ byte(0x5B); }
+    void ret(){ byte(0xC3); }
+    void movRbxRdi(){ byte(0x48); byte(0x89); byte(0xFB); } // mov rbx, rdi
+    void movRdiRbx(){ byte(0x48); byte(0x89); byte(0xDF); } // mov rdi, rbx
+    void movRsiImm64(uint64_t v){ byte(0x48); byte(0xBE); imm64(v); } // mov rsi, imm64
+    void movEdxImm32(uint32_t v){ byte(0xBA); imm32(v); } // mov edx, imm32
+    void movEaxImm32(uint32_t v){ byte(0xB8); imm32(v); } // mov eax, imm32
+    void movClImm8(uint8_t v){ byte(0xB1); byte(v); } // mov cl, imm8
+    void testEaxEax(){ byte(0x85); byte(0xC0); }
+    void setbAl(){ byte(0x0F); byte(0x92); byte(0xC0); } // setb al
+    void call(uint64_t target){ byte(0x48); byte(0xB8); imm64(target); byte(0xFF); byte(0xD0); } // mov rax, imm64; call rax
+
+    void loadAl(uint32_t disp){ rbxOperand(0x8A, 0, disp); } // mov al, [rbx+disp]
+    void loadCl(uint32_t disp){ rbxOperand(0x8A, 1, disp); } // mov cl, [rbx+disp]
+    void storeAl(uint32_t disp){ rbxOperand(0x88, 0, disp); } // mov [rbx+disp], al
+    void storeCl(uint32_t disp){ rbxOperand(0x88, 1, disp); } // mov [rbx+disp], cl
+    void storeByte(uint32_t disp, uint8_t v){ rbxOperand(0xC6, 0, disp); byte(v); } // mov byte [rbx+disp], imm8
+    void storeWord(uint32_t disp, uint16_t v){ byte(0x66); rbxOperand(0xC7, 0, disp); imm16(v); } // mov word [rbx+disp], imm16
+
+    // byte [rbx+disp] op imm8, ext is the /digit: 0 add, 2 adc, 3 sbb, 5 sub, 7 cmp
+    void byteImm(uint8_t ext, uint32_t disp, uint8_t v){ rbxOperand(0x80, ext, disp); byte(v); }
+    // word [rbx+disp] op sign extended imm8, same extensions
+    void wordImm(uint8_t ext, uint32_t disp, int8_t v){ byte(0x66); rbxOperand(0x83, ext, disp); byte(uint8_t(v)); }
+
+    // al op [rbx+disp], opcode is the r8, r/m8 form: 0x02 add, 0x2A sub, 0x3A cmp
+    void alMemory(uint8_t opcode, uint32_t disp){ rbxOperand(opcode, 0, disp); }
+    // al op cl, opcode is the r/m8, r8 form: 0x00 add, 0x28 sub, 0x20 and, 0x30 xor, 0x08 or
+    void alCl(uint8_t opcode){ byte(opcode); byte(0xC8); }
+    void incCl(){ byte(0xFE); byte(0xC1); }
+    void decCl(){ byte(0xFE); byte(0xC9); }
+
+    // jcc rel8, returns where the displacement lives so it can be patched
+    size_t jccShort(Condition condition){ byte(uint8_t(0x70 | condition)); byte(0); return bytes.size() - 1; }
+    void patchShort(size_t at){ bytes[at] = uint8_t(bytes.size() - (at + 1)); }
+
+    // jnz rel32, returns where the displacement lives so it can be patched
+    size_t jnz(){ byte(0x0F); byte(0x85); imm32(0); return bytes.size() - 4; }
+    void patch(size_t at, size_t target){
+        uint32_t rel = uint32_t(int32_t(target) - int32_t(at + 4));
+        std::memcpy(&bytes[at], &rel, 4);
+    }
+};
+
+}
+
+Jit::Jit(CPU& cpu) : cpu(cpu){
+#ifdef GB_JIT_X64
+    void* arena = mmap(nullptr, CODE_CAPACITY, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(arena != MAP_FAILED){
+        code = static_cast<uint8_t*>(arena);
+        mprotect(code, CODE_CAPACITY, PROT_READ | PROT_EXEC);
+    }
+#endif
+}
+
+Jit::~Jit(){
+#ifdef GB_JIT_X64
+    if(code) munmap(code, CODE_CAPACITY);
+#endif
+}
+
+bool Jit::compile(BasicBlock& block){
+#ifdef GB_JIT_X64
+    if(!code || block.count == 0) return false;
+
+    // register fields are addressed relative to the CPU pointer kept in rbx
+    auto offsetOf = [&](const void* field){
+        return uint32_t(static_cast<const uint8_t*>(field) - reinterpret_cast<const uint8_t*>(&cpu));
+    };
+    // operand order used by the opcode encoding, 6 is (HL)
+    const uint8_t* registers[8] = {&cpu.B, &cpu.C, &cpu.D, &cpu.E, &cpu.H, &cpu.L, nullptr, &cpu.A};
+    // BC DE HL SP as high and low byte, SP is a word of its own
+    const uint8_t* pairs[3][2] = {{&cpu.B, &cpu.C}, {&cpu.D, &cpu.E}, {&cpu.H, &cpu.L}};
+
+    const uint32_t A = offsetOf(&cpu.A);
+    const uint32_t PC = offsetOf(&cpu.PC);
+    const uint32_t SP = offsetOf(&cpu.SP);
+    const uint32_t flagOp = offsetOf(&cpu.flagOp);
+    const uint32_t flagLhs = offsetOf(&cpu.flagLhs);
+    const uint32_t flagRhs = offsetOf(&cpu.flagRhs);
+    const uint32_t flagCarry = offsetOf(&cpu.flagCarry);
+
+    // flag op the block itself last deferred, the interpreter may have left anything before that
+    CPU::FlagOp knownFlags = CPU::FlagOp::NONE;
+    bool flagsKnown = false;
+
+    // EI takes effect after the next instruction, the block stops at it so the host loop sees that
+    int count = 0;
+    while(count < block.count && block.instructions[count++].opcode != 0xFB){}
+
+    Emitter e;
+    std::vector<size_t> exits;
+    int pending = 0; // M cycles of native instructions not yet passed to Bus::step
+    uint16_t pc = block.startPC;
+
+    e.pushRbx(); // also realigns the stack to 16 bytes for the calls below
+    e.movRbxRdi();
+
+    // native code for an instruction when there is a template for it, false leaves it to the handler
+    auto emitNative = [&](const DecodedInstruction& instruction, bool last) -> bool{
+        uint8_t op = instruction.opcode;
+        int x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+        uint8_t n = instruction.operands[0];
+        uint16_t nn = uint16_t(instruction.operands[1] << 8 | instruction.operands[0]);
+        uint16_t next = uint16_t(pc + instruction.length);
+
+        if(op == 0x00) return true; // NOP
+
+        if(x == 1 && op != 0x76 && y != 6 && z != 6){ // LD r, r'
+            e.loadAl(offsetOf(registers[z]));
+            e.storeAl(offsetOf(registers[y]));
+            return true;
+        }
+        if(x == 0 && z == 6 && y != 6){ // LD r, d8
+            e.storeByte(offsetOf(registers[y]), n);
+            return true;
+        }
+        if(x == 0 && z == 1 && !(y & 1)){ // LD rr, d16
+            int pair = y >> 1;
+            if(pair == 3){
+                e.storeWord(SP, nn);
+            }else{
+                e.storeByte(offsetOf(pairs[pair][0]), uint8_t(nn >> 8));
+                e.storeByte(offsetOf(pairs[pair][1]), uint8_t(nn));
+            }
+            return true;
+        }
+        if(x == 0 && z == 3){ // INC rr, DEC rr, no flags
+            int pair = y >> 1;
+            bool dec = y & 1;
+            if(pair == 3){
+                e.wordImm(dec ? 5 : 0, SP, 1);
+            }else{
+                // low byte then the carry or borrow into the high byte
+                e.byteImm(dec ? 5 : 0, offsetOf(pairs[pair][1]), 1);
+                e.byteImm(dec ? 3 : 2, offsetOf(pairs[pair][0]), 0);
+            }
+            return true;
+        }
+        if(x == 0 && (z == 4 || z == 5) && y != 6){ // INC r, DEC r
+            // carry is left as it was, work it out from whatever op is deferred
+            if(flagsKnown && knownFlags == CPU::FlagOp::LOGIC){
+                e.storeByte(flagCarry, 0);
+            }else if(flagsKnown && (knownFlags == CPU::FlagOp::ADD || knownFlags == CPU::FlagOp::SUB)){
+                e.loadAl(flagLhs);
+                e.alMemory(knownFlags == CPU::FlagOp::ADD ? 0x02 : 0x3A, flagRhs);
+                e.setbAl();
+                e.storeAl(flagCarry);
+            }else if(!(flagsKnown && (knownFlags == CPU::FlagOp::INC || knownFlags == CPU::FlagOp::DEC))){
+                e.movRdiRbx();
+                e.call(reinterpret_cast<uintptr_t>(&Jit::carry));
+                e.storeAl(flagCarry);
+            }
+            uint32_t reg = offsetOf(registers[y]);
+            e.loadCl(reg);
+            e.storeCl(flagLhs);
+            e.storeByte(flagRhs, 0);
+            if(z == 4) e.incCl(); else e.decCl();
+            e.storeCl(reg);
+            knownFlags = z == 4 ? CPU::FlagOp::INC : CPU::FlagOp::DEC;
+            e.storeByte(flagOp, uint8_t(knownFlags));
+            flagsKnown = true;
+            return true;
+        }
+        if((x == 2 && z != 6) || (x == 3 && z == 6)){ // ALU A, r and ALU A, d8
+            if(y == 1 || y == 3) return false; // ADC and SBC need the carry, left to the handler
+            if(x == 2) e.loadCl(offsetOf(registers[z]));
+            else e.movClImm8(n);
+            e.loadAl(A);
+            if(y == 0 || y == 2 || y == 7){ // ADD SUB CP
+                e.storeAl(flagLhs);
+                e.storeCl(flagRhs);
+                if(y == 0) e.alCl(0x00);
+                if(y == 2) e.alCl(0x28);
+                if(y != 7) e.storeAl(A);
+                knownFlags = y == 0 ? CPU::FlagOp::ADD : CPU::FlagOp::SUB;
+            }else{ // AND XOR OR
+                e.alCl(y == 4 ? 0x20 : y == 5 ? 0x30 : 0x08);
+                e.storeAl(A);
+                e.storeAl(flagLhs);
+                e.storeByte(flagRhs, y == 4 ? CPU::hF : 0); // AND always sets half carry
+                knownFlags = CPU::FlagOp::LOGIC;
+            }
+            e.storeByte(flagCarry, 0);
+            e.storeByte(flagOp, uint8_t(knownFlags));
+            flagsKnown = true;
+            return true;
+        }
+
+        // jumps only ever come last, they end the block
+        if(!last) return false;
+        bool relative = op == 0x18 || op == 0x20 || op == 0x28 || op == 0x30 || op == 0x38;
+        bool absolute = op == 0xC3 || op == 0xC2 || op == 0xCA || op == 0xD2 || op == 0xDA;
+        if(!relative && !absolute) return false;
+        uint16_t target = relative ? uint16_t(next + int8_t(n)) : nn;
+        const OpcodeInfo& info = OPCODES[op];
+
+        if(op == 0x18 || op == 0xC3){ // JR e, JP nn
+            e.storeWord(PC, target);
+            e.movEaxImm32(uint32_t(pending + info.cycles));
+            return true;
+        }
+
+        // condition from bits 3-4, NZ Z NC C, only when the deferred op is one the block set
+        int condition = y & 3;
+        bool zero = condition < 2;
+        if(!flagsKnown) return false;
+        Condition notTaken;
+        switch(knownFlags){
+            case CPU::FlagOp::ADD:
+                e.loadAl(flagLhs);
+                e.alMemory(0x02, flagRhs); // ZF and CF of the 8 bit add
+                notTaken = zero ? (condition == 1 ? NOT_EQUAL : EQUAL) : (condition == 3 ? NOT_BELOW : BELOW);
+                break;
+            case CPU::FlagOp::SUB:
+                e.loadAl(flagLhs);
+                e.alMemory(0x3A, flagRhs); // equal is zero, below is borrow
+                notTaken = zero ? (condition == 1 ? NOT_EQUAL : EQUAL) : (condition == 3 ? NOT_BELOW : BELOW);
+                break;
+            case CPU::FlagOp::LOGIC:
+                if(!zero){
+                    // carry is always clear, the branch goes the same way every time
+                    bool taken = condition == 2;
+                    e.storeWord(PC, taken ? target : next);
+                    e.movEaxImm32(uint32_t(pending + (taken ? info.cyclesTaken : info.cycles)));
+                    return true;
+                }
+                e.byteImm(7, flagLhs, 0);
+                notTaken = condition == 1 ? NOT_EQUAL : EQUAL;
+                break;
+            case CPU::FlagOp::INC:
+            case CPU::FlagOp::DEC:
+                if(zero){
+                    // INC gives zero from 0xFF, DEC from 1
+                    e.byteImm(7, flagLhs, knownFlags == CPU::FlagOp::INC ? 0xFF : 0x01);
+                    notTaken = condition == 1 ? NOT_EQUAL : EQUAL;
+                }else{
+                    e.byteImm(7, flagCarry, 0); // equal means carry clear
+                    notTaken = condition == 3 ? EQUAL : NOT_EQUAL;
+                }
+                break;
+            default:
+                return false;
+        }
+        e.storeWord(PC, next);
+        e.movEaxImm32(uint32_t(pending + info.cycles));
+        size_t skip = e.jccShort(notTaken);
+        e.storeWord(PC, target);
+        e.movEaxImm32(uint32_t(pending + info.cyclesTaken));
+        e.patchShort(skip);
+        return true;
+    };
+
+    for(int i = 0; i < count; ++i){
+        const DecodedInstruction& instruction = block.instructions[i];
+        bool last = (i == count - 1);
+
+        if(emitNative(instruction, last)){
+            pc = uint16_t(pc + instruction.length);
+            if(!last){
+                pending += instruction.cycles;
+            }else if(!(instruction.opcode == 0x18 || instruction.opcode == 0xC3 ||
+                     (instruction.opcode & 0xE7) == 0x20 || (instruction.opcode & 0xE7) == 0xC2)){
+                // straight line end, the host loop carries on at the next instruction
+                e.storeWord(PC, pc);
+                e.movEaxImm32(uint32_t(pending + instruction.cycles));
+            }
+            continue;
+        }
+
+        // the handler sees PC, the clock and memory exactly where the interpreter would have them
+        e.storeWord(PC, pc);
+        e.movRdiRbx();
+        e.movRsiImm64(reinterpret_cast<uintptr_t>(&instruction));
+        e.movEdxImm32(uint32_t(pending));
+        pending = 0;
+        flagsKnown = false;
+        pc = uint16_t(pc + instruction.length);
+        if(last){
+            // its cycles go back to the host loop, which also checks for interrupts before the next step
+            e.call(reinterpret_cast<uintptr_t>(&Jit::executeInstruction));
+        }else{
+            e.call(reinterpret_cast<uintptr_t>(&Jit::executeInBlock));
+            e.testEaxEax();
+            exits.push_back(e.jnz());
+        }
+    }
+    e.popRbx();
+    e.ret();
+
+    // early exit, every cycle so far has already gone through Bus::step
+    size_t exitLabel = e.bytes.size();
+    for(size_t at : exits) e.patch(at, exitLabel);
+    e.movEaxImm32(0);
+    e.popRbx();
+    e.ret();
+
+    if(used + e.bytes.size() > CODE_CAPACITY){
+        return false; // arena full, remaining blocks stay interpreted
+    }
+
+    mprotect(code, CODE_CAPACITY, PROT_READ | PROT_WRITE);
+    std::memcpy(code + used, e.bytes.data(), e.bytes.size());
+    mprotect(code, CODE_CAPACITY, PROT_READ | PROT_EXEC);
+
+    block.compiled = reinterpret_cast<uintptr_t>(code + used);
+    used += (e.bytes.size() + 15) & ~size_t(15);
+    return true;
+#else
+    (void)block;
+    return false;
+#endif
+}
+
+int Jit::run(const BasicBlock& block){
+    using BlockFunction = int(*)(CPU*);
+    entryBankSwitchCount = cpu.bus.bankSwitchCount();
+    return reinterpret_cast<BlockFunction>(block.compiled)(&cpu);
+}
+
+int Jit::executeInstruction(CPU* cpu, const DecodedInstruction* instruction, int pendingCycles){
+    // native instructions before this one only moved registers, the clock catches up on them now
+    if(pendingCycles) cpu->bus.step(pendingCycles * 4);
+    cpu->PC++;
+    cpu->operands = instruction->operands;
+    cpu->beginInstruction();
+    int cycles = opcodeTable[instruction->opcode](*cpu, cpu->bus);
+    cpu->operands = nullptr;
+    return cpu->endInstruction(cycles);
+}
+
+int Jit::executeInBlock(CPU* cpu, const DecodedInstruction* instruction, int pendingCycles){
+    Bus& bus = cpu->bus;
+    bus.step(executeInstruction(cpu, instruction, pendingCycles) * 4);
+
+    // anything that changes what runs next or what the block was decoded from ends it here
+    if(bus.bankSwitchCount() != cpu->jit.entryBankSwitchCount || bus.ppu.isOamDmaActive()) return 1;
+    if(cpu->halted || cpu->stopped || bus.ppu.isFrameReady()) return 1;
+    return cpu->IME && bus.interrupts.hasPending();
+}
+
+int Jit::carry(CPU* cpu){
+    return cpu->carryFlag() ? 1 : 0;
+}
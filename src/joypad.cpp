@@ -0,0 +1,46 @@
+#include "joypad.h"
+#include "io.h"
+
+Joypad::Joypad(){}
+
+void Joypad::mapRegisters(IO& io){
+    io.attach(JOYP_ADDRESS, JOYP_ADDRESS, *this);
+    io.setMasks(JOYP_ADDRESS, 0xC0, 0x30); // bits 6-7 dont exist, 0-3 are the keys
+}
+
+uint8_t Joypad::read(uint16_t) const{
+    // Active low register, (joyp init to 11001111)
+    uint8_t reg = select | 0x0F;
+
+    // D pad, bit 4 = 0
+    if(!(select & 0x10)){
+        if(keys[4]) reg &= ~(1 << 0); // Right pressed
+        if(keys[5]) reg &= ~(1 << 1); // Left pressed
+        if(keys[6]) reg &= ~(1 << 2); // Up pressed
+        if(keys[7]) reg &= ~(1 << 3); // Down pressed
+    }
+
+    if(!(select & 0x20)){
+        if(keys[0]) reg &= ~(1 << 0); // A pressed
+        if(keys[1]) reg &= ~(1 << 1); // B pressed
+        if(keys[2]) reg &= ~(1 << 2); // Select pressed
+        if(keys[3]) reg &= ~(1 << 3); // Start pressed
+    }
+
+    return reg;
+}
+
+void Joypad::write(uint16_t, uint8_t byte){
+    select = byte & 0x30;
+}
+
+bool Joypad::setKeyState(const bool keyState[8]){
+    bool requestInterrupt = false;
+    for(int i = 0; i < 8; ++i){
+        bool was = keys[i];
+        bool now = keyState[i];
+        if(!was && now) requestInterrupt = true; // rising edge
+        keys[i] = now;
+    }
+    return requestInterrupt;
+}
@@ -0,0 +1,326 @@
+#include "pixels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define GB_PIXELS_SSE2 1 // part of x86-64, always there
+#include <emmintrin.h>
+#endif
+
+#if defined(GB_PIXELS_SSE2) && defined(__GNUC__)
+#define GB_PIXELS_AVX2 1 // compiled per function with a target attribute, only run after checking the cpu
+#include <immintrin.h>
+#endif
+
+namespace{
+
+// shade a 2 bit colour index maps to through BGP, OBP0 or OBP1
+inline uint8_t shadeOf(uint8_t palette, uint8_t index){
+    return (palette >> (index * 2)) & 0x03;
+}
+
+void decodeTileRowScalar(uint8_t low, uint8_t high, uint8_t* out){
+    for(int bit = 7; bit >= 0; --bit){
+        *out++ = uint8_t(((high >> bit) & 1) << 1 | ((low >> bit) & 1));
+    }
+}
+
+void composeLineScalar(const uint8_t* bg, const uint8_t* sprites, uint8_t bgp, uint8_t obp0, uint8_t obp1,
+                       uint8_t* out, int count){
+    for(int x = 0; x < count; ++x){
+        out[x] = PixelKernels::composePixel(bg[x], sprites[x], bgp, obp0, obp1);
+    }
+}
+
+void expandShadesScalar(const uint8_t* shades, const uint32_t palette[4], uint32_t* out, int count){
+    for(int i = 0; i < count; ++i){
+        out[i] = palette[shades[i] & 3];
+    }
+}
+
+void expandShades16Scalar(const uint8_t* shades, const uint16_t palette[4], uint16_t* out, int count){
+    for(int i = 0; i < count; ++i){
+        out[i] = palette[shades[i] & 3];
+    }
+}
+
+void packShadesScalar(const uint8_t* shades, uint8_t* out, int count){
+    for(int i = 0; i + 4 <= count; i += 4){
+        *out++ = uint8_t((shades[i] & 3) << 6 | (shades[i + 1] & 3) << 4 | (shades[i + 2] & 3) << 2 | (shades[i + 3] & 3));
+    }
+}
+
+#ifdef GB_PIXELS_SSE2
+
+// SSE2 has no byte shuffle, small tables are looked up with one compare per entry
+inline __m128i lookup4(__m128i index, uint8_t palette){
+    __m128i result = _mm_setzero_si128();
+    for(int i = 0; i < 4; ++i){
+        __m128i match = _mm_cmpeq_epi8(index, _mm_set1_epi8(char(i)));
+        result = _mm_or_si128(result, _mm_and_si128(match, _mm_set1_epi8(char(shadeOf(palette, uint8_t(i))))));
+    }
+    return result;
+}
+
+void decodeTileRowSse2(uint8_t low, uint8_t high, uint8_t* out){
+    // lane i tests bit 7-i of each plane
+    const __m128i bits = _mm_setr_epi8(char(0x80), 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m128i lowSet = _mm_cmpeq_epi8(_mm_and_si128(_mm_set1_epi8(char(low)), bits), bits);
+    __m128i highSet = _mm_cmpeq_epi8(_mm_and_si128(_mm_set1_epi8(char(high)), bits), bits);
+    __m128i colours = _mm_or_si128(_mm_and_si128(lowSet, _mm_set1_epi8(1)), _mm_and_si128(highSet, _mm_set1_epi8(2)));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), colours);
+}
+
+void composeLineSse2(const uint8_t* bg, const uint8_t* sprites, uint8_t bgp, uint8_t obp0, uint8_t obp1,
+                     uint8_t* out, int count){
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i colourMask = _mm_set1_epi8(0x03);
+    const __m128i paletteBit = _mm_set1_epi8(0x04);
+    const __m128i behindBit = _mm_set1_epi8(0x08);
+
+    int x = 0;
+    for(; x + 16 <= count; x += 16){
+        __m128i back = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bg + x));
+        __m128i sprite = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sprites + x));
+        __m128i colour = _mm_and_si128(sprite, colourMask);
+
+        // covers = colour != 0 && (not behind || bg == 0)
+        __m128i transparent = _mm_cmpeq_epi8(colour, zero);
+        __m128i inFront = _mm_cmpeq_epi8(_mm_and_si128(sprite, behindBit), zero);
+        __m128i covers = _mm_andnot_si128(transparent, _mm_or_si128(inFront, _mm_cmpeq_epi8(back, zero)));
+
+        __m128i useObp1 = _mm_cmpeq_epi8(_mm_and_si128(sprite, paletteBit), paletteBit);
+        __m128i objShade = _mm_or_si128(_mm_andnot_si128(useObp1, lookup4(colour, obp0)),
+                                        _mm_and_si128(useObp1, lookup4(colour, obp1)));
+        __m128i bgShade = lookup4(back, bgp);
+
+        __m128i shade = _mm_or_si128(_mm_and_si128(covers, objShade), _mm_andnot_si128(covers, bgShade));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), shade);
+    }
+    composeLineScalar(bg + x, sprites + x, bgp, obp0, obp1, out + x, count - x);
+}
+
+void expandShadesSse2(const uint8_t* shades, const uint32_t palette[4], uint32_t* out, int count){
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask = _mm_set1_epi32(3);
+    __m128i colours[4];
+    for(int i = 0; i < 4; ++i) colours[i] = _mm_set1_epi32(int(palette[i]));
+
+    int i = 0;
+    for(; i + 16 <= count; i += 16){
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(shades + i));
+        __m128i words[2] = {_mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero)};
+        for(int half = 0; half < 2; ++half){
+            __m128i dwords[2] = {_mm_unpacklo_epi16(words[half], zero), _mm_unpackhi_epi16(words[half], zero)};
+            for(int quarter = 0; quarter < 2; ++quarter){
+                __m128i index = _mm_and_si128(dwords[quarter], mask);
+                __m128i result = zero;
+                for(int shade = 0; shade < 4; ++shade){
+                    __m128i match = _mm_cmpeq_epi32(index, _mm_set1_epi32(shade));
+                    result = _mm_or_si128(result, _mm_and_si128(match, colours[shade]));
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + half * 8 + quarter * 4), result);
+            }
+        }
+    }
+    expandShadesScalar(shades + i, palette, out + i, count - i);
+}
+
+void expandShades16Sse2(const uint8_t* shades, const uint16_t palette[4], uint16_t* out, int count){
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask = _mm_set1_epi16(3);
+    __m128i colours[4];
+    for(int i = 0; i < 4; ++i) colours[i] = _mm_set1_epi16(short(palette[i]));
+
+    int i = 0;
+    for(; i + 16 <= count; i += 16){
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(shades + i));
+        __m128i words[2] = {_mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero)};
+        for(int half = 0; half < 2; ++half){
+            __m128i index = _mm_and_si128(words[half], mask);
+            __m128i result = zero;
+            for(int shade = 0; shade < 4; ++shade){
+                __m128i match = _mm_cmpeq_epi16(index, _mm_set1_epi16(short(shade)));
+                result = _mm_or_si128(result, _mm_and_si128(match, colours[shade]));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + half * 8), result);
+        }
+    }
+    expandShades16Scalar(shades + i, palette, out + i, count - i);
+}
+
+// the four shades in each 32 bit lane packed into its low byte, first shade in bits 7-6
+inline __m128i packLanes(__m128i shades){
+    __m128i packed = _mm_and_si128(_mm_slli_epi32(shades, 6), _mm_set1_epi32(0xC0));
+    packed = _mm_or_si128(packed, _mm_and_si128(_mm_srli_epi32(shades, 4), _mm_set1_epi32(0x30)));
+    packed = _mm_or_si128(packed, _mm_and_si128(_mm_srli_epi32(shades, 14), _mm_set1_epi32(0x0C)));
+    return _mm_or_si128(packed, _mm_and_si128(_mm_srli_epi32(shades, 24), _mm_set1_epi32(0x03)));
+}
+
+void packShadesSse2(const uint8_t* shades, uint8_t* out, int count){
+    int i = 0;
+    for(; i + 64 <= count; i += 64){
+        __m128i lanes[4];
+        for(int part = 0; part < 4; ++part){
+            lanes[part] = packLanes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(shades + i + part * 16)));
+        }
+        // lanes only hold 0-255 so the saturating packs just narrow them
+        __m128i words = _mm_packs_epi32(lanes[0], lanes[1]);
+        __m128i words2 = _mm_packs_epi32(lanes[2], lanes[3]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i / 4), _mm_packus_epi16(words, words2));
+    }
+    packShadesScalar(shades + i, out + i / 4, count - i);
+}
+
+#endif
+
+#ifdef GB_PIXELS_AVX2
+
+// palette as a byte table for vpshufb, which only indexes within each 128 bit lane so it is repeated in both
+__attribute__((target("avx2"))) inline __m256i shadeTable(uint8_t low, uint8_t high){
+    alignas(16) uint8_t table[16] = {};
+    for(int i = 0; i < 4; ++i){
+        table[i] = shadeOf(low, uint8_t(i));
+        table[4 + i] = shadeOf(high, uint8_t(i));
+    }
+    return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(table)));
+}
+
+// any 4 byte table the same way
+__attribute__((target("avx2"))) inline __m256i byteTable(const uint8_t values[4]){
+    return _mm256_broadcastsi128_si256(_mm_setr_epi8(char(values[0]), char(values[1]), char(values[2]), char(values[3]),
+                                                     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0));
+}
+
+__attribute__((target("avx2")))
+void composeLineAvx2(const uint8_t* bg, const uint8_t* sprites, uint8_t bgp, uint8_t obp0, uint8_t obp1,
+                     uint8_t* out, int count){
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i colourMask = _mm256_set1_epi8(0x03);
+    const __m256i indexMask = _mm256_set1_epi8(0x07); // colour and OBP1 bit index the object table
+    const __m256i behindBit = _mm256_set1_epi8(0x08);
+    const __m256i bgTable = shadeTable(bgp, bgp);
+    const __m256i objTable = shadeTable(obp0, obp1);
+
+    int x = 0;
+    for(; x + 32 <= count; x += 32){
+        __m256i back = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bg + x));
+        __m256i sprite = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sprites + x));
+
+        __m256i transparent = _mm256_cmpeq_epi8(_mm256_and_si256(sprite, colourMask), zero);
+        __m256i inFront = _mm256_cmpeq_epi8(_mm256_and_si256(sprite, behindBit), zero);
+        __m256i covers = _mm256_andnot_si256(transparent, _mm256_or_si256(inFront, _mm256_cmpeq_epi8(back, zero)));
+
+        __m256i objShade = _mm256_shuffle_epi8(objTable, _mm256_and_si256(sprite, indexMask));
+        __m256i bgShade = _mm256_shuffle_epi8(bgTable, back);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_blendv_epi8(bgShade, objShade, covers));
+    }
+    composeLineSse2(bg + x, sprites + x, bgp, obp0, obp1, out + x, count - x);
+}
+
+__attribute__((target("avx2")))
+void expandShadesAvx2(const uint8_t* shades, const uint32_t palette[4], uint32_t* out, int count){
+    const __m256i colours = _mm256_setr_epi32(int(palette[0]), int(palette[1]), int(palette[2]), int(palette[3]), 0, 0, 0, 0);
+    const __m256i mask = _mm256_set1_epi32(3);
+
+    int i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m256i index = _mm256_and_si256(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(shades + i))), mask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permutevar8x32_epi32(colours, index));
+    }
+    expandShadesSse2(shades + i, palette, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void expandShades16Avx2(const uint8_t* shades, const uint16_t palette[4], uint16_t* out, int count){
+    // low and high bytes of each colour looked up separately, then interleaved back into words
+    uint8_t lowBytes[4], highBytes[4];
+    for(int i = 0; i < 4; ++i){
+        lowBytes[i] = uint8_t(palette[i]);
+        highBytes[i] = uint8_t(palette[i] >> 8);
+    }
+    const __m256i lowTable = byteTable(lowBytes);
+    const __m256i highTable = byteTable(highBytes);
+    const __m256i mask = _mm256_set1_epi8(0x03);
+
+    int i = 0;
+    for(; i + 32 <= count; i += 32){
+        __m256i index = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(shades + i)), mask);
+        __m256i low = _mm256_shuffle_epi8(lowTable, index);
+        __m256i high = _mm256_shuffle_epi8(highTable, index);
+        // unpacking works within each 128 bit lane, giving pixels 0-7 and 16-23 then 8-15 and 24-31
+        __m256i first = _mm256_unpacklo_epi8(low, high);
+        __m256i second = _mm256_unpackhi_epi8(low, high);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + 16), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+    expandShades16Sse2(shades + i, palette, out + i, count - i);
+}
+
+__attribute__((target("avx2"))) inline __m256i packLanesAvx2(__m256i shades){
+    __m256i packed = _mm256_and_si256(_mm256_slli_epi32(shades, 6), _mm256_set1_epi32(0xC0));
+    packed = _mm256_or_si256(packed, _mm256_and_si256(_mm256_srli_epi32(shades, 4), _mm256_set1_epi32(0x30)));
+    packed = _mm256_or_si256(packed, _mm256_and_si256(_mm256_srli_epi32(shades, 14), _mm256_set1_epi32(0x0C)));
+    return _mm256_or_si256(packed, _mm256_and_si256(_mm256_srli_epi32(shades, 24), _mm256_set1_epi32(0x03)));
+}
+
+__attribute__((target("avx2")))
+void packShadesAvx2(const uint8_t* shades, uint8_t* out, int count){
+    // the packs work within each 128 bit lane, this puts the 4 byte groups back in order
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    int i = 0;
+    for(; i + 128 <= count; i += 128){
+        __m256i lanes[4];
+        for(int part = 0; part < 4; ++part){
+            lanes[part] = packLanesAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(shades + i + part * 32)));
+        }
+        __m256i words = _mm256_packs_epi32(lanes[0], lanes[1]);
+        __m256i words2 = _mm256_packs_epi32(lanes[2], lanes[3]);
+        __m256i bytes = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(words, words2), order);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i / 4), bytes);
+    }
+    packShadesSse2(shades + i, out + i / 4, count - i);
+}
+
+#endif
+
+PixelKernels kernelsFor(PixelKernels::Level level){
+    switch(level){
+#ifdef GB_PIXELS_AVX2
+        // tile rows are only 8 pixels, too short to gain anything over SSE2
+        case PixelKernels::Level::AVX2: return {decodeTileRowSse2, composeLineAvx2, expandShadesAvx2, expandShades16Avx2, packShadesAvx2, level};
+#endif
+#ifdef GB_PIXELS_SSE2
+        case PixelKernels::Level::SSE2: return {decodeTileRowSse2, composeLineSse2, expandShadesSse2, expandShades16Sse2, packShadesSse2, level};
+#endif
+        default: return {decodeTileRowScalar, composeLineScalar, expandShadesScalar, expandShades16Scalar, packShadesScalar, PixelKernels::Level::SCALAR};
+    }
+}
+
+PixelKernels& active(){
+    static PixelKernels kernels = kernelsFor(PixelKernels::detect());
+    return kernels;
+}
+
+}
+
+const PixelKernels& PixelKernels::get(){
+    return active();
+}
+
+PixelKernels::Level PixelKernels::detect(){
+#ifdef GB_PIXELS_AVX2
+    if(__builtin_cpu_supports("avx2")) return Level::AVX2;
+#endif
+#ifdef GB_PIXELS_SSE2
+    return Level::SSE2;
+#else
+    return Level::SCALAR;
+#endif
+}
+
+bool PixelKernels::select(Level level){
+    if(level > detect()) return false;
+    active() = kernelsFor(level);
+    return true;
+}
@@ -1,19 +1,46 @@
 #include "ppu.h"
 #include "cpu.h"
+#include "io.h"
+#include "bus.h"
+#include "framequeue.h"
 #include <cstring>
-#include <unordered_set> // just keys no values
 #include <vector>
-#include <algorithm> // stable_sort
+#include <algorithm> // min, max, clamp
+#include <climits>
 #include <iostream>
 
-PPU::PPU(Bus& bus) : bus(bus), LCDC(0x91), STAT(0x85), SCY(0x00), SCX(0x00),
-                     LY(0x00), LYC(0x00), BGP(0xFC), WY(0x00), WX(0x00){
+template<PPUFidelity Fidelity>
+BasicPPU<Fidelity>::BasicPPU(Bus& bus) : bus(bus), LCDC(0x91), STAT(0x85), SCY(0x00), SCX(0x00),
+                                                LY(0x00), LYC(0x00), BGP(0xFC), WY(0x00), WX(0x00){
     scanlineSprites.reserve(10);
     std::memset(vram, 0, sizeof(vram));
+    std::memset(decodedTiles, 0, sizeof(decodedTiles)); // blank tiles decode to colour 0
+    std::memset(decodedTilesFlipped, 0, sizeof(decodedTilesFlipped));
     std::memset(oam, 0, sizeof(oam));
 }
 
-void PPU::step(int tStates, CPU& cpu){
+template<PPUFidelity Fidelity>
+void BasicPPU<Fidelity>::catchUp(){
+    uint64_t now = bus.scheduler.getNow();
+    if(now == lastSync) return;
+    step(int(now - lastSync));
+    lastSync = now;
+}
+
+template<PPUFidelity Fidelity>
+void BasicPPU<Fidelity>::onEvent(){
+    catchUp();
+    reschedule();
+}
+
+template<PPUFidelity Fidelity>
+void BasicPPU<Fidelity>::reschedule(){
+    int cycles = eager ? cyclesUntilModeChange() : cyclesUntilInterrupt();
+    bus.scheduler.schedule(Scheduler::PPU, cycles > 0 ? cycles : Scheduler::MAX_EVENT_DISTANCE);
+}
+
+template<PPUFidelity Fidelity>
+void BasicPPU<Fidelity>::step(int tStates){
     stepDma(tStates);
 
     if(!(LCDC & 0x80)) return; // LCDC.7 is enable if off ppu is idle
@@ -26,7 +53,11 @@ void PPU::step(int tStates, CPU& cpu){
 
         switch(mode){
             case 2: needed = 80; break; // OAM scan = 80 dots
-            case 3: { // pixel transfer, length can be different
+            case 3: if constexpr(Fidelity == PPUFidelity::FIFO){
+                // the line ends when the FIFO has shifted out its last pixel
+                runPixelFifo();
+                needed = fifo.lcdX == 160 ? fifo.dot : dotCounter + 1;
+            }else{ // pixel transfer, length can be different
                 int base = 160; // outputs one pixel to the screen per dot, 160 pixels wide
                 int basePenalty = 12; // 12 dot penalty for initial two tile fetches
                 int scrollPenalty = SCX % 8; // background scroll penalty
@@ -35,11 +66,7 @@ void PPU::step(int tStates, CPU& cpu){
                 needed = base + basePenalty + scrollPenalty + windowPenalty + objPenalty;
             }
             break;
-            case 0: { // HBlank
-                int mode3length = 172 + (SCX % 8) + (((LCDC & 0x20) && LY >= WY) ? 6 : 0) + lastMode3Penalty;
-                needed = 376 - mode3length;
-            }
-            break;
+            case 0: needed = hblankLength(); break; // HBlank
             case 1: needed = 456; break; // VBlank, each line is 456 dots
             default: needed = 0; break;
         }
@@ -68,15 +95,25 @@ void PPU::step(int tStates, CPU& cpu){
                 }
                 // OAM scan finished, enter mode 3
                 STAT = (STAT & ~0x03) | 3;
+                if constexpr(Fidelity == PPUFidelity::FIFO) beginPixelTransfer();
             }
             break;
             case 3: {
-                renderScanline();
+                if constexpr(Fidelity == PPUFidelity::FIFO){
+                    // pixels are already out
+                    lastMode3Length = needed;
+                    if(renderingFrame){
+                        frameChanging = true;
+                        outputLine();
+                    }
+                }else if(renderingFrame){
+                    renderScanline();
+                }
                 // switch to mode 0
                 STAT = (STAT & ~0x03) | 0;
                 if(STAT & (1 << 3)){
                     // if mode 0 interrupt is enabled bit 3, request it
-                    cpu.requestInterrupt(CPU::Interrupt::LCD);
+                    bus.interrupts.request(CPU::Interrupt::LCD);
                 }
             }
             break;
@@ -88,7 +125,7 @@ void PPU::step(int tStates, CPU& cpu){
                 if (LY == LYC){
                     STAT |= (1 << 2);
                     if(STAT & (1 << 6)){ // bit 6 STAT = LYC=LY interupt enable
-                        cpu.requestInterrupt(CPU::Interrupt::LCD);
+                        bus.interrupts.request(CPU::Interrupt::LCD);
                     }
                 }else{
                     STAT &= ~(1 << 2);
@@ -98,12 +135,13 @@ void PPU::step(int tStates, CPU& cpu){
                     // enter vblank mode line 144 to 153
                     STAT = (STAT & ~0x03) | 1; // mode 1
                     frameReady = true;
+                    endFrame();
 
-                    cpu.requestInterrupt(CPU::Interrupt::VBLANK);
+                    bus.interrupts.request(CPU::Interrupt::VBLANK);
 
                     // STAT mode 1 interupt if enabled
                     if(STAT & (1 << 4)){    // STAT bit 4 mode 1 int enable
-                        cpu.requestInterrupt(CPU::Interrupt::LCD);
+                        bus.interrupts.request(CPU::Interrupt::LCD);
                     }
                 }else if(LY > 153){
                     // wrap back to line 0 after VBLANK lines
@@ -113,7 +151,7 @@ void PPU::step(int tStates, CPU& cpu){
                     // more visible lines mode 2
                     STAT = (STAT & ~0x03) | 2;
                     if(STAT & (1 << 5)){    // STAT bit 5 mode 2 interupt enable
-                        cpu.requestInterrupt(CPU::Interrupt::LCD);
+                        bus.interrupts.request(CPU::Interrupt::LCD);
                     }
                 }
             } 
@@ -123,7 +161,7 @@ void PPU::step(int tStates, CPU& cpu){
                 if(LY == LYC){
                     STAT |= (1 << 2);
                     if(STAT & (1 << 6)){
-                        cpu.requestInterrupt(CPU::Interrupt::LCD);
+                        bus.interrupts.request(CPU::Interrupt::LCD);
                     }
                 }else{
                     STAT &= ~(1 << 2);
@@ -135,7 +173,7 @@ void PPU::step(int tStates, CPU& cpu){
                     STAT = (STAT & ~0x03) | 2;
                     // if mode 2 stat interupts are enabled request one
                     if(STAT & (1 << 5)){ // STAT bit 5 mode 2 interupt enable
-                        cpu.requestInterrupt(CPU::Interrupt::LCD);
+                        bus.interrupts.request(CPU::Interrupt::LCD);
                     }
                 }else{
                     STAT = (STAT & ~0x03) | 1;
@@ -146,7 +184,131 @@ void PPU::step(int tStates, CPU& cpu){
     }
 }
 
-uint8_t PPU::read(uint16_t address) const{
+template<PPUFidelity Fidelity>
+void BasicPPU<Fidelity>::endFrame(){
+    frameRendered = renderingFrame;
+    frameChanged = frameChanging;
+    frameChanging = false;
+    if(frameChanged) framePublished = false;
+    if(frameQueue && !framePublished) publishFrame();
+    frameNumber++;
+    if(renderFrame){
+        renderingFrame = renderFrame(frameNumber);
+    }else{
+        // skip frameSkip frames then draw one
+        renderingFrame = frameNumber % uint64_t(frameSkip + 1) == uint64_t(frameSkip);
+    }
+}
+
+template<PPUFidelity Fidelity>
+int BasicPPU<Fidelity>::cyclesUntilModeChange() const{
+    if(!(LCDC & 0x80)) return -1;
+
+    int needed = 0;
+    switch(STAT & 0x03){
+        case 2: needed = 80; break;
+        case 3:
+            needed = mode3MinimumLength(); // object penalty left out, see header
+            if constexpr(Fidelity == PPUFidelity::FIFO){
+                // every pixel still to drop or shift out takes a dot, stalls can push the end past the minimum
+                needed = std::max(needed, fifo.dot + fifo.stall + fifo.discard + (160 - fifo.lcdX));
+            }
+            break;
+        case 0: needed = hblankLength(); break;
+        case 1: needed = 456; break;
+    }
+
+    int cycles = needed - dotCounter;
+    return cycles > 0 ? cycles : 1;
+}
+
+template<PPUFidelity Fidelity>
+int BasicPPU<Fidelity>::mode3MinimumLength() const{
+    if constexpr(Fidelity == PPUFidelity::FIFO){
+        // the fine scroll is latched as mode 3 starts, and the window only costs anything once WX is reached
+        int discard = (STAT & 0x03) == 3 ? fifo.lineDiscard : SCX % 8;
+        return 172 + discard;
+    }else{
+        int windowPenalty = ((LCDC & 0x20) && LY >= WY) ? 6 : 0;
+        return 172 + (SCX % 8) + windowPenalty;
+    }
+}
+
+template<PPUFidelity Fidelity>
+int BasicPPU<Fidelity>::hblankLength() const{
+    if constexpr(Fidelity == PPUFidelity::FIFO){
+        return 376 - lastMode3Length;
+    }else{
+        int mode3length = 172 + (SCX % 8) + (((LCDC & 0x20) && LY >= WY) ? 6 : 0) + lastMode3Penalty;
+        return 376 - mode3length;
+    }
+}
+
+template<PPUFidelity Fidelity>
+void BasicPPU<Fidelity>::mapRegisters(IO& io){
+    io.attach(LCDC_ADDRESS, WX_ADDRESS, *this);
+    io.setMasks(STAT_ADDRESS, 0x80, 0x78); // bit 7 doesnt exist, the mode and coincidence bits are read only
+    io.setMasks(LY_ADDRESS, 0x00, 0x00); // read only
+}
+
+template<PPUFidelity Fidelity>
+int BasicPPU<Fidelity>::cyclesUntilInterrupt() const{
+    if(!(LCDC & 0x80)) return -1;
+
+    constexpr int LINE = 456;
+    // later lines may have the window on, leaving it out keeps their mode 3 a lower bound
+    int nextLineHBlank = 80 + 172 + (SCX % 8);
+    bool hblankInterrupt = STAT & (1 << 3);
+    bool vblankInterrupt = STAT & (1 << 4);
+    bool oamInterrupt = STAT & (1 << 5);
+    bool lycInterrupt = STAT & (1 << 6);
+    (void)vblankInterrupt; // raised with the VBlank interrupt, which is always scheduled
+
+    int cycles = INT_MAX;
+    int lineEnd = 0; // dots until LY next increments
+    switch(STAT & 0x03){
+        case 2:
+            lineEnd = LINE - dotCounter;
+            if(hblankInterrupt) cycles = 80 - dotCounter + mode3MinimumLength();
+            break;
+        case 3:
+            lineEnd = LINE - 80 - dotCounter;
+            if(hblankInterrupt) cycles = cyclesUntilModeChange();
+            break;
+        case 0: lineEnd = cyclesUntilModeChange(); break;
+        case 1: lineEnd = LINE - dotCounter; break;
+    }
+
+    if((STAT & 0x03) != 1){
+        // visible line, the next VBlank comes when line 143 ends
+        cycles = std::min(cycles, lineEnd + (143 - LY) * LINE);
+        if(LY < 143){
+            if(oamInterrupt) cycles = std::min(cycles, lineEnd);
+            if(hblankInterrupt) cycles = std::min(cycles, lineEnd + nextLineHBlank);
+        }
+        if(lycInterrupt && LYC > LY && LYC <= 144){
+            cycles = std::min(cycles, lineEnd + (LYC - LY - 1) * LINE);
+        }
+    }else{
+        // VBlank, line 0 of the next frame starts when line 153 ends
+        int frameStart = lineEnd + (153 - LY) * LINE;
+        cycles = std::min(cycles, frameStart + 144 * LINE);
+        if(oamInterrupt) cycles = std::min(cycles, frameStart);
+        if(hblankInterrupt) cycles = std::min(cycles, frameStart + nextLineHBlank);
+        if(lycInterrupt){
+            // LY == LYC is only checked as LY goes up, never as it wraps to 0
+            if(LYC > LY && LYC <= 153) cycles = std::min(cycles, lineEnd + (LYC - LY - 1) * LINE);
+            else if(LYC >= 1 && LYC <= 144) cycles = std::min(cycles, frameStart + LYC * LINE);
+        }
+    }
+
+    return cycles > 0 ? cycles : 1;
+}
+
+template<PPUFidelity Fidelity>
+uint8_t BasicPPU<Fidelity>::read(uint16_t address){
+    catchUp();
+
     // VRAM 8000-9FFF, cant access during mode 3, pixel transfer
     if(address >= 0x8000 && address <= 0x9FFF){
         return vramAccessible() ? vram[address - 0x8000] : 0xFF;
@@ -174,12 +336,16 @@ uint8_t PPU::read(uint16_t address) const{
     }
 }
 
-void PPU::write(uint16_t address, uint8_t byte){
+template<PPUFidelity Fidelity>
+void BasicPPU<Fidelity>::write(uint16_t address, uint8_t byte){
+    catchUp();
+
     // DMA
     if(address == 0xFF46){
         dmaSource = uint16_t(byte) << 8;
         oamDmaActive = true;
         oamDmaCycles = 160;
+        bus.scheduler.schedule(Scheduler::OAM_DMA, oamDmaCycles);
 
         for(int i = 0; i < 0xA0; ++i){
             oam[i] = bus.readDuringDMA(dmaSource + i);
@@ -191,7 +357,12 @@ void PPU::write(uint16_t address, uint8_t byte){
     // VRAM 8000-9FFF, blocked in mode 3
     if(address >= 0x8000 && address <= 0x9FFF){
         if(vramAccessible()){
-            vram[address - 0x8000] = byte;
+            // rewriting the same byte changes nothing a line is drawn from
+            if(vram[address - 0x8000] != byte){
+                vram[address - 0x8000] = byte;
+                vramGeneration++;
+                if(address < 0x9800) updateDecodedTile(address);
+            }
         }else{
             return;
         }
@@ -218,7 +389,7 @@ void PPU::write(uint16_t address, uint8_t byte){
                 enableLCD();
             }
         } break;
-        case STAT_ADDRESS: STAT = (STAT & 0x87) | (byte & 0x78); break; // only bit 3-6 are writable
+        case STAT_ADDRESS: STAT = byte; break; // IO only lets bits 3-6 through
         case SCY_ADDRESS: SCY = byte; break;
         case SCX_ADDRESS: SCX = byte; break;
         case LY_ADDRESS: break; // read only
@@ -228,262 +399,363 @@ void PPU::write(uint16_t address, uint8_t byte){
         case OBP1_ADDRESS: OBP1 = byte; break;
         case WY_ADDRESS: WY = byte; break;
         case WX_ADDRESS: WX = byte; break;
-        default: break;
+        default: return;
     }
+    // LCDC, SCX and WX all move the end of mode 3
+    reschedule();
 }
 
-int PPU::computeObjPenalty(){
-    int penalty = 0;
-    std::unordered_set<uint16_t> seenTiles;
+template<PPUFidelity Fidelity>
+int BasicPPU<Fidelity>::computeObjPenalty(ObjFetch* fetches){
+    // sprites sorted from leftmost to rightmost, X in the high bits and the index in the low 4 so
+    // sprites at the same X stay in OAM order, unused slots sort to the end
+    int keys[10];
+    int count = static_cast<int>(scanlineSprites.size());
+    for(int i = 0; i < 10; ++i){
+        // gameboy stores sprite X postion in offset of +8 pixels, so X itself is never negative
+        keys[i] = i < count ? scanlineSprites[i].x * 16 + i : INT_MAX;
+    }
 
-    struct S{
-        int px, index;
-        const Sprite* s;
+    // sorting network for 10 inputs
+    static constexpr uint8_t NETWORK[29][2] = {
+        {4,9}, {3,8}, {2,7}, {1,6}, {0,5}, {1,4}, {6,9}, {0,3}, {5,8}, {0,2}, {3,6}, {7,9}, {0,1}, {2,4}, {5,7},
+        {8,9}, {1,2}, {4,6}, {7,8}, {3,5}, {2,5}, {6,8}, {1,3}, {4,7}, {2,3}, {6,7}, {3,4}, {5,6}, {4,5}
     };
-
-    // sprites sorted from leftmost to rightmost with things with equal values sorted by index
-    std::vector<S> sortedSprites;
-
-    for(int i =0; i < static_cast<int>(scanlineSprites.size()); ++i){
-        const Sprite& sprite = scanlineSprites[i];
-        // gameboy stores sprite X postion in offset of +8 pixels
-        sortedSprites.push_back({sprite.x - 8, i, &sprite});
+    for(const auto& [a, b] : NETWORK){
+        int low = std::min(keys[a], keys[b]);
+        keys[b] = std::max(keys[a], keys[b]);
+        keys[a] = low;
     }
 
-    // stable sort preserves order of values that compare equal, so sorts on index if x is equal
-    std::stable_sort(sortedSprites.begin(), sortedSprites.end(), [](const S& a, const S& b){return a.px < b.px;});
+    // same logic as render fetcher, every tile on the line is in one of two tile map rows
+    bool windowVisible = (LCDC & 0x20) && (LY >= WY);
+    uint16_t backgRow = ((LCDC & 0x08) ? 0x9C00 : 0x9800) + (((LY + SCY) & 0xFF) / 8) * 32;
+    uint16_t windowRow = ((LCDC & 0x40) ? 0x9C00 : 0x9800) + ((LY - WY) / 8) * 32;
 
-    for(S& val : sortedSprites){
-        const Sprite& sp = *val.s;
-        int px = sp.x - 8;
+    // one bit per tile column already stalled on, both rows share one if they are the same row
+    uint32_t backgFetched = 0, windowOnly = 0;
+    uint32_t& windowFetched = (windowRow == backgRow) ? backgFetched : windowOnly;
+
+    int penalty = 0;
+    for(int i = 0; i < count; ++i){
+        int x = keys[i] / 16 - 8;
+        int stall = 0;
 
-        if(sp.x == 0){
+        if(x == -8){
             // fixed penalty of 11 for completely leftside of the screen sprites
-            penalty += 11;
-            continue;
-        }
-        if (px < 0 || px >= 160){
+            stall = 11;
+        }else if(x >= 0 && x < 160){
             // penalty only counts for sprites visible in the 0-159 X range ("OBJs overlapping the scanline are considered")
-            continue;
-        }   
-
-        // fixed 6 dot fetch tile penalty
-        penalty += 6;
-
-        // same logic as render fetcher
-        bool inWindow = (LCDC & 0x20) && (LY >= WY) && (px >= WX - 7);
-        uint16_t mapBase = (!inWindow && (LCDC & 0x08)) ? 0x9C00
-                         : (inWindow && (LCDC & 0x40)) ? 0x9C00 : 0x9800;
-
-        int tileCol = inWindow ? (px - (WX - 7)) / 8 : ((SCX + px) / 8) & 0x1F;
-        int tileRow = inWindow ? (LY - WY) / 8 : ((LY + SCY) & 0xFF) / 8;
-
-        uint16_t tileAddress = mapBase + tileRow * 32 + tileCol;
-
-        // If havent stalled for this tile add the penalty
-        if(!seenTiles.count(tileAddress)){
-            seenTiles.insert(tileAddress);
-            // gets pixels X inside its 8 pixel tile
-            int withinTileX = inWindow ? (px - (WX - 7)) % 8 : (SCX + px) % 8;
-
-            // 7 - withinTile X gets how many pixels are to the right, and then minus 2
-            int pen = (7 - withinTileX) - 2;
-            if(pen > 0){
-                penalty += pen;
+            // fixed 6 dot fetch tile penalty
+            stall = 6;
+
+            bool inWindow = windowVisible && (x >= WX - 7);
+            int fetcherX = inWindow ? x - (WX - 7) : (SCX + x);
+            int tileCol = inWindow ? fetcherX / 8 : (fetcherX / 8) & 0x1F;
+            uint32_t& fetched = inWindow ? windowFetched : backgFetched;
+
+            // If havent stalled for this tile add the penalty
+            if(!(fetched & (1u << tileCol))){
+                fetched |= 1u << tileCol;
+                // gets pixels X inside its 8 pixel tile
+                int withinTileX = fetcherX % 8;
+
+                // 7 - withinTile X gets how many pixels are to the right, and then minus 2
+                int pen = (7 - withinTileX) - 2;
+                if(pen > 0){
+                    stall += pen;
+                }
             }
         }
+
+        penalty += stall;
+        if(fetches){
+            fetches[i] = {uint8_t(keys[i] % 16), int16_t(x), uint8_t(stall)};
+        }
     }
     lastMode3Penalty = penalty;
     return penalty;
 }
 
-void PPU::renderScanline(){
-    if (LY >= 144) {
-        // guard to prevent rendering in vblank lines
-        std::cerr << "[WARNING] renderScanline() called with LY >= 144 (" << int(LY) << "), skipping.\n";
-        return;
-    }
-
-    backgroundFIFO.clear();
-    spriteFIFO.clear();
-
-    std::vector<SpritePixel> spriteLine(160, {0,false,0});
+template<PPUFidelity Fidelity>
+void BasicPPU<Fidelity>::fetchTileRow(bool window, int tileCol, uint8_t* out) const{
+    // LCDC.4=1 0x8000 usigned index, LCDC.4=0 0x8800 signed index
+    uint16_t mapBase =
+        (!window && (LCDC & 0x08)) ? 0x9C00 :
+        ( window && (LCDC & 0x40)) ? 0x9C00 : 0x9800;
 
-    int spriteHeight = (LCDC & (1<<2)) ? 16 : 8;
-
-    for(const Sprite& sprite : scanlineSprites){
-        int oY = sprite.y;
-        int oX = sprite.x;
-        int tile = sprite.tileIndex;
-        int flags = sprite.flags;
+    int fetcherY = window ? (LY - WY) : ((LY + SCY) & 0xFF);
 
-        // which row of this sprite to draw
-        int row = LY + 16 - oY;
+    uint16_t tileMapAddress = mapBase + (fetcherY / 8) * 32 + (tileCol & 0x1F); // 0x1F = 31 base 10, columns are indexs from 0-31
+    uint8_t tileIndex = vramReadRaw(tileMapAddress);
 
-        if(flags & 0x40){   // y flip flag
-            row = spriteHeight - 1 - row;
-        }
-
-        // for 8x16 sprites, low bit of tileIndex switches between the two tiles
-        if(spriteHeight == 16){
-            // force top half tile index to be even
-            tile &= 0xFE;
-            // if on bottom half of sprite pick the next tile
-            if((LY + 16 - oY) >= 8) tile |= 1;
-        }
+    int fineY = fetcherY % 8;
 
-        // get rows 2 bytes from 0x8000
-        uint16_t address = 0x8000 + tile*16 + row*2;
-        if (address >= 0xA000) {
-            std::cerr << "[ERROR] Sprite tile address out-of-bounds: 0x" << std::hex << address << "\n";
-            std::exit(1);
-        }
-        uint8_t low = vramReadRaw(address);
-        uint8_t high = vramReadRaw(address + 1);
+    uint16_t addressLow;
+    if (LCDC & 0x10) {
+        addressLow = 0x8000 + uint16_t(tileIndex) * 16 + fineY * 2;
+    } else {
+        int16_t sIndex = int8_t(tileIndex);
+        addressLow = uint16_t(int32_t(0x9000) + sIndex * 16 + fineY * 2);
+    }
 
-        bool xFlip = flags & 0x20;
-        bool bgPriority = flags & 0x80; // obj to background priority
-        uint8_t palette = (flags & 0x10) ? 1 : 0; // OBP1 or OBP0
+    std::memcpy(out, decodedTileRow(addressLow), 8);
+}
 
-        for(int bit = 7; bit >= 0; --bit){
-            uint8_t colour = ((high >> bit) & 1) << 1 | ((low >> bit) & 1);
-            if(colour == 0){
-                continue; // transparent
-            }
+template<PPUFidelity Fidelity>
+const uint8_t* BasicPPU<Fidelity>::spriteRow(const Sprite& sprite, uint8_t& attributes) const{
+    int spriteHeight = (LCDC & (1<<2)) ? 16 : 8;
+    int oY = sprite.y;
+    int tile = sprite.tileIndex;
+    int flags = sprite.flags;
 
-            // compute actual screen X of sprite pixel
-            int px = oX - 8 + (xFlip ? (bit) : (7- bit));
-            if(px < 0 || px >= 160){
-                continue; // off screen pixels
-            }
+    // which row of this sprite to draw
+    int row = LY + 16 - oY;
 
-            // when two sprites overlap at the same x the one that was scanned first in mode 2 decides pixel colour
-            if(spriteLine[px].colour == 0){
-                spriteLine[px] = {colour, bgPriority, palette};
-            }
-        }
+    if(flags & 0x40){   // y flip flag
+        row = spriteHeight - 1 - row;
     }
 
-    // helper to push one 8 pixel background/window tile row into the FIFO
-    auto pushTileRow = [&](bool window, int tileCol){
-        // LCDC.4=1 0x8000 usigned index, LCDC.4=0 0x8800 signed index
-        uint16_t mapBase =
-            (!window && (LCDC & 0x08)) ? 0x9C00 :
-            ( window && (LCDC & 0x40)) ? 0x9C00 : 0x9800;
-
-        int tileRow = window ? (LY - WY) / 8 : ((LY + SCY) & 0xFF) / 8;
+    // for 8x16 sprites, low bit of tileIndex switches between the two tiles
+    if(spriteHeight == 16){
+        // force top half tile index to be even
+        tile &= 0xFE;
+        // if on bottom half of sprite pick the next tile
+        if((LY + 16 - oY) >= 8) tile |= 1;
+    }
 
-        uint16_t tileMapAddress = mapBase + tileRow * 32 + (tileCol & 0x1F); // 0x1F = 31 base 10, columns are indexs from 0-31
-        uint8_t tileIndex = vramReadRaw(tileMapAddress);
+    // get rows 2 bytes from 0x8000
+    uint16_t address = 0x8000 + tile*16 + row*2;
+    if (address >= 0xA000) {
+        std::cerr << "[ERROR] Sprite tile address out-of-bounds: 0x" << std::hex << address << "\n";
+        std::exit(1);
+    }
 
-        int fetcherY = window ? (LY - WY) : ((LY + SCY) & 0xFF);
-        int fineY = fetcherY % 8;
+    attributes = ((flags & 0x10) ? 0x04 : 0) | ((flags & 0x80) ? 0x08 : 0); // OBP1, obj to background priority
+    return decodedTileRow(address, flags & 0x20); // x flip flag
+}
 
-        uint16_t addressLow;
-        if (LCDC & 0x10) {
-            addressLow = 0x8000 + uint16_t(tileIndex) * 16 + fineY * 2;
-        } else {
-            int16_t sIndex = int8_t(tileIndex);
-            addressLow = uint16_t(int32_t(0x9000) + sIndex * 16 + fineY * 2);
-        }
+template<PPUFidelity Fidelity>
+void BasicPPU<Fidelity>::renderScanline(){
+    if (LY >= 144) {
+        // guard to prevent rendering in vblank lines
+        std::cerr << "[WARNING] renderScanline() called with LY >= 144 (" << int(LY) << "), skipping.\n";
+        return;
+    }
 
-        uint8_t low  = vramReadRaw(addressLow);
-        uint8_t high = vramReadRaw(addressLow + 1);
+    // a line drawn from the same inputs as last time would come out the same, keep what is there
+    LineInputs inputs{};
+    inputs.vramGeneration = vramGeneration;
+    inputs.registers = {LCDC, SCY, SCX, BGP, OBP0, OBP1, WY, WX};
+    inputs.spriteCount = uint8_t(scanlineSprites.size());
+    std::copy(scanlineSprites.begin(), scanlineSprites.end(), inputs.sprites.begin());
+    inputs.valid = true;
+    if(lineInputs[LY] == inputs){
+        return;
+    }
+    lineInputs[LY] = inputs;
+    frameChanging = true;
+
+    // sprite pixels for the line, 0 where no sprite covers it
+    // bits 1-0 colour, bit 2 palette (OBP1), bit 3 behind background
+    uint8_t spriteLine[160] = {};
+
+    // with objects off (LCDC.1) the line stays empty
+    if(LCDC & 0x02){
+        for(const Sprite& sprite : scanlineSprites){
+            uint8_t attributes;
+            const uint8_t* pixels = spriteRow(sprite, attributes);
+
+            for(int i = 0; i < 8; ++i){
+                uint8_t colour = pixels[i];
+                int px = sprite.x - 8 + i; // actual screen X of sprite pixel
+                if(colour == 0 || px < 0 || px >= 160){
+                    continue; // transparent or off screen
+                }
 
-        for (int bit = 7; bit >= 0; --bit) {
-            uint8_t c = (((high >> bit) & 1) << 1) | ((low >> bit) & 1);
-            backgroundFIFO.push_back(c);
+                // when two sprites overlap at the same x the one that was scanned first in mode 2 decides pixel colour
+                if(spriteLine[px] == 0){
+                    spriteLine[px] = colour | attributes;
+                }
+            }
         }
-    };
+    }
 
-    // initial fetch and fine scroll drop
+    // background/window colours, pixel x of the line is at x + scxFine
+    // 21 tiles cover the line plus the fine scroll, the window can start up to 7 pixels into the last one
+    uint8_t bgLine[22 * 8];
     const int scxFine = SCX & 7; // same as % 8, more efficient
     int backgTileCol = (SCX >> 3) & 0x1F; // same as / 8, again more efficient
-    int windowTileCol = 0; // window starts at column 0
 
+    // the window covers everything from WX-7 to the end of the line
+    int windowStart = 160;
+    if((LCDC & 0x20) && LY >= WY){
+        windowStart = std::clamp(WX - 7, 0, 160);
+    }
 
-    bool inWindow0 = ((0 >= (WX - 7)) && (LY >= WY) && (LCDC & 0x20));
-
-    if(inWindow0){
-        pushTileRow(true, 0);
-        windowTileCol = (windowTileCol + 1) & 0x1F; // advance to next col
-    }else{
-        pushTileRow(false, backgTileCol);
-        int drop = scxFine; // one time fine drop
-        while (drop-- > 0 && !backgroundFIFO.empty()) backgroundFIFO.pop_front();
+    for(int pos = 0; pos < scxFine + windowStart; pos += 8){
+        fetchTileRow(false, backgTileCol, bgLine + pos);
         backgTileCol = (backgTileCol + 1) & 0x1F; // next tile
     }
+    for(int x = windowStart, windowTileCol = 0; x < 160; x += 8){
+        fetchTileRow(true, windowTileCol++, bgLine + scxFine + x);
+    }
 
-    bool prevInWindow = inWindow0;
-
-    // iterate over the 160 horizontal pixels
-    for(int x = 0; x < 160; ++x){
-        bool inWindow = (x >= (WX-7)) && (LY >= WY) && (LCDC & 0x20);
-
-        if(!prevInWindow && inWindow){
-            // if just entered window then clear bg fifo
-            backgroundFIFO.clear();
-            windowTileCol = 0;
-        }
+    // sprites over the background, both through their palettes
+    PixelKernels::get().composeLine(bgLine + scxFine, spriteLine, BGP, OBP0, OBP1, frameBuffer + LY*160, 160);
+    outputLine();
+}
 
-        if(backgroundFIFO.size() < 8){
-            // refill fifo when low
-            if(inWindow){
-                pushTileRow(true, windowTileCol++);
-            }else{
-                pushTileRow(false, backgTileCol);
-                backgTileCol = (backgTileCol + 1) & 0x1F;
-            }
-        }
+template<PPUFidelity Fidelity>
+void BasicPPU<Fidelity>::setOutput(void* buffer, PixelFormat format, int pitch){
+    if(pitch == 0) pitch = PixelKernels::lineBytes(format);
+    if(buffer == output && format == outputFormat && pitch == outputPitch) return;
+    output = static_cast<uint8_t*>(buffer);
+    outputFormat = format;
+    outputPitch = pitch;
+    invalidateLines();
+}
 
-        // push sprite pixel
-        spriteFIFO.push_back(spriteLine[x]);
+template<PPUFidelity Fidelity>
+bool BasicPPU<Fidelity>::setFrameQueue(FrameQueue* queue){
+    if(queue && queue->getFrameBytes() < getFrameBytes()){
+        std::cerr << "[ERROR] Frame queue frames are " << queue->getFrameBytes() << " bytes, need " << getFrameBytes() << "\n";
+        return false;
+    }
+    frameQueue = queue;
+    framePublished = false;
+    return true;
+}
 
-        // pixel rendering
-        uint8_t bgColour = backgroundFIFO.front();
-        backgroundFIFO.pop_front();
+template<PPUFidelity Fidelity>
+void BasicPPU<Fidelity>::publishFrame(){
+    // setOutput can change the frame size after the queue was set, never copy past its frames
+    size_t bytes = std::min(getFrameBytes(), frameQueue->getFrameBytes());
+    std::memcpy(frameQueue->writeBuffer(), output ? output : frameBuffer, bytes);
+    frameQueue->publish(frameNumber);
+    framePublished = true;
+}
 
-        uint8_t objColour = 0;
-        bool objHasPriority = false;
-        uint8_t objPalette = 0;
+template<PPUFidelity Fidelity>
+void BasicPPU<Fidelity>::setPalette(const uint32_t palette[4]){
+    for(int i = 0; i < 4; ++i){
+        outputPalette[i] = palette[i];
+        outputPalette16[i] = PixelKernels::toRgb565(palette[i]);
+    }
+    invalidateLines();
+}
 
-        if((LCDC & 0x02) && !spriteFIFO.empty()){   // if obj enable and queue is empty
-            SpritePixel sprite = spriteFIFO.front();
-            spriteFIFO.pop_front();
+template<PPUFidelity Fidelity>
+void BasicPPU<Fidelity>::invalidateLines(){
+    for(LineInputs& inputs : lineInputs) inputs.valid = false;
+}
 
-            objColour = sprite.colour;
-            objPalette = sprite.palette;
+template<PPUFidelity Fidelity>
+void BasicPPU<Fidelity>::outputLine(){
+    if(!output) return;
+
+    const uint8_t* shades = frameBuffer + LY*160;
+    uint8_t* line = output + LY*outputPitch;
+    const PixelKernels& kernels = PixelKernels::get();
+    switch(outputFormat){
+        case PixelFormat::INDEXED8: std::memcpy(line, shades, 160); break;
+        case PixelFormat::PACKED2BPP: kernels.packShades(shades, line, 160); break;
+        case PixelFormat::RGB565: kernels.expandShades16(shades, outputPalette16, reinterpret_cast<uint16_t*>(line), 160); break;
+        case PixelFormat::RGBA8888: kernels.expandShades(shades, outputPalette, reinterpret_cast<uint32_t*>(line), 160); break;
+    }
+}
 
-            // non transparent and background priority flag
-            if(objColour != 0 && !sprite.bgPriority){
-                objHasPriority = true;
-            }
-        }
+template<PPUFidelity Fidelity>
+void BasicPPU<Fidelity>::beginPixelTransfer(){
+    fifo = PixelFifo{};
+    fifo.discard = fifo.lineDiscard = SCX & 7;
+    fifo.fetchDots = -6; // the first fetch is thrown away, so the first row takes 12 dots
+    computeObjPenalty(fifo.fetches);
+    fifo.fetchCount = static_cast<int>(scanlineSprites.size());
+}
 
-        // objcolour == 0 then use backg
-        // if objs priority flag is clear (obj over backg), it covers background regardless of backgrounds colour
-        // if objs priority flag is set (obj behind backg), it only shows when the background pixel is colour 0
-        bool spriteCovers = (objColour != 0) && (objHasPriority || (bgColour == 0));
+template<PPUFidelity Fidelity>
+void BasicPPU<Fidelity>::runPixelFifo(){
+    while(fifo.dot < dotCounter && fifo.lcdX < 160){
+        fifo.dot++;
+        tickPixelFifo();
+    }
+}
 
-        uint8_t finalIndex = spriteCovers ? objColour : bgColour;
+template<PPUFidelity Fidelity>
+void BasicPPU<Fidelity>::tickPixelFifo(){
+    if(fifo.stall > 0){
+        // fetching a sprite holds up both the fetcher and the shifter
+        fifo.stall--;
+        return;
+    }
 
-        uint8_t shade;
-        if(spriteCovers){
-            uint8_t paletteReg = (objPalette == 0) ? OBP0 : OBP1;
-            shade = (paletteReg >> (finalIndex*2)) & 0x03;
+    // shifter, one pixel per dot while the FIFO has any
+    if(fifo.rowLeft > 0){
+        if(fifo.discard > 0){
+            // fine scroll, the first pixels of the line are shifted out but never drawn
+            fifo.discard--;
+            fifo.rowPos++;
+            fifo.rowLeft--;
+        }else if(!fifo.inWindow && (LCDC & 0x20) && LY >= WY && fifo.lcdX >= WX - 7){
+            // window starts, the background pixels are dropped and the fetcher starts over on window tile 0
+            fifo.inWindow = true;
+            fifo.rowLeft = 0;
+            fifo.fetched = false;
+            fifo.fetchDots = 0;
         }else{
-            shade = (BGP >> (finalIndex*2)) & 0x03;
-        }
-
-        int fbIndex = LY*160 + x;
+            // sprites starting here are fetched before the pixel goes out
+            int stall = 0;
+            while(fifo.nextFetch < fifo.fetchCount && std::max<int>(fifo.fetches[fifo.nextFetch].x, 0) <= fifo.lcdX){
+                const ObjFetch& fetch = fifo.fetches[fifo.nextFetch++];
+                stall += fetch.stall;
+
+                uint8_t attributes;
+                const uint8_t* pixels = spriteRow(scanlineSprites[fetch.sprite], attributes);
+                for(int i = 0; i < 8; ++i){
+                    int x = fetch.x + i;
+                    if(pixels[i] == 0 || x < fifo.lcdX || x >= 160) continue; // transparent or already gone
+                    // sprites fetched earlier keep their pixels, so the leftmost sprite wins an overlap
+                    uint8_t& slot = fifo.sprites[x & 7];
+                    if(slot == 0) slot = pixels[i] | attributes;
+                }
+            }
+            if(stall > 0){
+                fifo.stall = stall - 1; // this dot is the first of the stall
+                return;
+            }
 
-        if(fbIndex >= 160 * 144){
-            std::cerr << "[ERROR] frameBuffer index out of range: " << fbIndex << "\n";
-            std::exit(1);
+            uint8_t bg = fifo.row[fifo.rowPos++];
+            fifo.rowLeft--;
+            uint8_t& sprite = fifo.sprites[fifo.lcdX & 7];
+            if(renderingFrame){
+                // palettes and object enable are read as the pixel goes out
+                uint8_t object = (LCDC & 0x02) ? sprite : 0;
+                frameBuffer[LY*160 + fifo.lcdX] = PixelKernels::composePixel(bg, object, BGP, OBP0, OBP1);
+            }
+            sprite = 0;
+            fifo.lcdX++;
         }
+    }
 
-        frameBuffer[LY*160 + x] = shade;
-
-        prevInWindow = inWindow;
+    // fetcher, a tile row takes 6 dots then waits for the FIFO to empty
+    if(!fifo.fetched && ++fifo.fetchDots >= 6){
+        if(fifo.inWindow){
+            fetchTileRow(true, fifo.windowTileCol++, fifo.nextRow);
+        }else{
+            // SCX is read for every tile so coarse scroll changes land mid line
+            fetchTileRow(false, (SCX >> 3) + fifo.backgFetches++, fifo.nextRow);
+        }
+        fifo.fetched = true;
+    }
+    if(fifo.rowLeft == 0 && fifo.fetched){
+        std::memcpy(fifo.row, fifo.nextRow, 8);
+        fifo.rowPos = 0;
+        fifo.rowLeft = 8;
+        fifo.fetched = false;
+        fifo.fetchDots = 0;
     }
 }
+
+template class BasicPPU<PPUFidelity::SCANLINE>;
+template class BasicPPU<PPUFidelity::FIFO>;
@@ -0,0 +1,28 @@
+#include "scheduler.h"
+
+void Scheduler::schedule(Event event, int tStates){
+    deadlines[event] = now + uint64_t(tStates);
+    findEarliest();
+}
+
+void Scheduler::cancel(Event event){
+    deadlines[event] = NEVER;
+    findEarliest();
+}
+
+Scheduler::Event Scheduler::popDue(){
+    Event due = TIMER;
+    for(int event = 1; event < EVENT_COUNT; ++event){
+        if(deadlines[event] < deadlines[due]) due = Event(event);
+    }
+    deadlines[due] = NEVER;
+    findEarliest();
+    return due;
+}
+
+void Scheduler::findEarliest(){
+    earliest = NEVER;
+    for(uint64_t deadline : deadlines){
+        if(deadline < earliest) earliest = deadline;
+    }
+}
@@ -1,37 +1,74 @@
 #include "timer.h"
 #include "cpu.h"
+#include "io.h"
+#include "scheduler.h"
+#include "interrupts.h"
 
-Timer::Timer() : DIV(0xAB), TIMA(0x00), TMA(0x00), TAC(0xF8){}
+Timer::Timer(Scheduler& scheduler, InterruptController& interrupts) : scheduler(scheduler), interrupts(interrupts),
+                                                                      TIMA(0x00), TMA(0x00), TAC(0x00){
+    // DIV starts at 0xAB with the rest of the counter clear
+    counterOrigin = scheduler.getNow() - 0xAB00;
+    lastSync = scheduler.getNow();
+    reschedule();
+}
 
-void Timer::step(int tStates, CPU& cpu){
-    // div increments at 16384Hz, so 64 mcycles, 256 tstates
-    divCounter += tStates;
-    while(divCounter >= 256){
-        DIV = uint8_t(DIV + 1); // automatically wraps round 255+1-> 0
-        divCounter -= 256; // remove the 256 that it wrapped around
-    }
+void Timer::onEvent(){
+    catchUp();
+    reschedule();
+}
 
-    // if TAC enable (bit 2)
+void Timer::catchUp(){
+    uint64_t now = scheduler.getNow();
+    if(now == lastSync) return;
     if(TAC & 0x04){
-        int freq = FREQUENCIES[TAC & 0x03];
-        timaCounter += tStates;
-
-        while(timaCounter >= freq){
-            timaCounter -= freq;
-            if(TIMA == 0xFF){
-                // overflow
-                TIMA = TMA;
-                cpu.requestInterrupt(CPU::TIMER);
-            }else{
-                TIMA++;
-            }
-        }
+        // falling edges happen whenever the counter reaches a multiple of the period
+        uint64_t period = FREQUENCIES[TAC & 0x03];
+        increment(counterAt(now) / period - counterAt(lastSync) / period);
+    }
+    lastSync = now;
+}
+
+void Timer::increment(uint64_t increments){
+    if(increments <= uint64_t(0xFF - TIMA)){
+        TIMA = uint8_t(TIMA + increments);
+        return;
     }
+    // overflow, TIMA reloads from TMA and carries on counting from there
+    increments -= 0x100 - TIMA;
+    uint64_t reloadPeriod = 0x100 - TMA;
+    TIMA = uint8_t(TMA + increments % reloadPeriod);
+    interrupts.request(CPU::TIMER);
 }
 
-uint8_t Timer::read(uint16_t address) const{
+void Timer::reschedule(){
+    int cycles = cyclesUntilInterrupt();
+    if(cycles > 0){
+        scheduler.schedule(Scheduler::TIMER, cycles);
+    }else{
+        scheduler.cancel(Scheduler::TIMER);
+    }
+}
+
+int Timer::cyclesUntilInterrupt() const{
+    if(!(TAC & 0x04)) return -1;
+    uint64_t period = FREQUENCIES[TAC & 0x03];
+    // the next falling edge, then one more per count left before TIMA wraps
+    uint64_t nextEdge = (counterAt(lastSync) / period + 1) * period;
+    uint64_t overflow = counterOrigin + nextEdge + (0xFF - TIMA) * period;
+    int cycles = int(overflow - scheduler.getNow());
+    return cycles > 0 ? cycles : 1;
+}
+
+void Timer::mapRegisters(IO& io){
+    io.attach(DIV_ADDRESS, TAC_ADDRESS, *this);
+    io.setMasks(TAC_ADDRESS, 0xF8, 0xFF); // only bits 2-0 of TAC exist
+}
+
+uint8_t Timer::read(uint16_t address){
+    catchUp();
+    readCount++;
     switch(address){
-        case DIV_ADDRESS: return DIV; // FF04
+        case DIV_ADDRESS: return uint8_t(counterAt(lastSync) >> 8); // FF04
         case TIMA_ADDRESS: return TIMA; // FF05
         case TMA_ADDRESS: return TMA; // FF06
         case TAC_ADDRESS: return TAC; // FF07
@@ -40,12 +77,18 @@ uint8_t Timer::read(uint16_t address) const{
 }
 
 void Timer::write(uint16_t address, uint8_t byte){
+    catchUp();
+    // resetting the counter or changing TAC can drop the signal TIMA watches, which counts as a falling edge
+    bool signalBefore = timerSignal(counterAt(lastSync));
     switch(address){
-        case DIV_ADDRESS: DIV = 0; divCounter = 0; break; // FF04 any write resets it and its counter
+        case DIV_ADDRESS: counterOrigin = lastSync; break; // FF04 any write resets the whole counter
         case TIMA_ADDRESS: TIMA = byte; break; // FF05
         case TMA_ADDRESS: TMA = byte; break; // FF06
         case TAC_ADDRESS: TAC = byte & 0x07; break; // FF07, only bits 2-0 are used
         default: break;
     }
+    if(signalBefore && !timerSignal(counterAt(lastSync))){
+        increment(1);
+    }
+    reschedule();
 }
-
@@ -0,0 +1,74 @@
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+
+TraceBuffer::TraceBuffer(size_t capacity){
+    size_t size = 1;
+    while(size < capacity) size <<= 1;
+    entries.resize(size);
+    mask = size - 1;
+}
+
+size_t TraceBuffer::pop(TraceEntry* out, size_t maxEntries){
+    size_t position = tail.load(std::memory_order_relaxed);
+    size_t available = head.load(std::memory_order_acquire) - position;
+    size_t count = available < maxEntries ? available : maxEntries;
+    for(size_t i = 0; i < count; ++i){
+        out[i] = entries[(position + i) & mask];
+    }
+    tail.store(position + count, std::memory_order_release);
+    return count;
+}
+
+TraceWriter::TraceWriter(TraceBuffer& buffer, const std::string& path, uint64_t maxEntries) : buffer(buffer), file(path, std::ios::binary | std::ios::trunc){
+    if(!file) return;
+    header.capacity = maxEntries > 0 ? maxEntries : 1;
+    file.write(TRACE_FILE_MAGIC, sizeof(TRACE_FILE_MAGIC));
+    writeHeader();
+    thread = std::thread(&TraceWriter::run, this);
+}
+
+TraceWriter::~TraceWriter(){
+    stopping.store(true, std::memory_order_release);
+    if(thread.joinable()) thread.join();
+}
+
+void TraceWriter::run(){
+    std::vector<TraceEntry> batch(BATCH_ENTRIES);
+    while(true){
+        // read the flag before draining so nothing pushed before the stop request is missed
+        bool stop = stopping.load(std::memory_order_acquire);
+        size_t count = buffer.pop(batch.data(), batch.size());
+        if(count > 0){
+            writeEntries(batch.data(), count);
+            writeHeader();
+            file.flush();
+            continue;
+        }
+        if(stop){
+            // the last drops may have had nothing after them to mark, the header still counts them
+            writeHeader();
+            file.flush();
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void TraceWriter::writeEntries(const TraceEntry* entries, size_t count){
+    while(count > 0){
+        uint64_t slot = header.written % header.capacity;
+        size_t run = size_t(std::min<uint64_t>(count, header.capacity - slot));
+        file.seekp(std::streamoff(sizeof(TRACE_FILE_MAGIC) + sizeof(TraceFileHeader) + slot * sizeof(TraceEntry)));
+        file.write(reinterpret_cast<const char*>(entries), std::streamsize(run * sizeof(TraceEntry)));
+        header.written += run;
+        entries += run;
+        count -= run;
+    }
+}
+
+void TraceWriter::writeHeader(){
+    header.dropped = buffer.getDropped();
+    file.seekp(std::streamoff(sizeof(TRACE_FILE_MAGIC)));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
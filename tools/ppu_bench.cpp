@@ -0,0 +1,85 @@
+#include "bus.h"
+#include "cartridge.h"
+#include "pixels.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Times the PPU on its own with every visible line carrying the full 10 sprites, which is the
+// worst case for the OAM scan, the mode 3 object penalty and sprite rendering. Lines are written
+// out in one of the output pixel formats like the frontend has them
+int main(int argc, char* argv[]){
+    if(argc < 2){
+        std::cerr << "Usage: " << argv[0] << " <path-to-rom.gb> [--frames=N] [--simd=scalar|sse2|avx2] [--format=indexed|2bpp|rgb565|rgba8888]\n";
+        return 1;
+    }
+
+    int frames = 20000;
+    PixelFormat format = PixelFormat::RGBA8888;
+    for(int i = 2; i < argc; ++i){
+        const std::string arg = argv[i];
+        if(arg.rfind("--frames=", 0) == 0) frames = std::atoi(arg.c_str() + 9);
+        else if(arg == "--simd=scalar") PixelKernels::select(PixelKernels::Level::SCALAR);
+        else if(arg == "--simd=sse2") PixelKernels::select(PixelKernels::Level::SSE2);
+        else if(arg == "--simd=avx2") PixelKernels::select(PixelKernels::Level::AVX2);
+        else if(arg == "--format=indexed") format = PixelFormat::INDEXED8;
+        else if(arg == "--format=2bpp") format = PixelFormat::PACKED2BPP;
+        else if(arg == "--format=rgb565") format = PixelFormat::RGB565;
+        else if(arg == "--format=rgba8888") format = PixelFormat::RGBA8888;
+    }
+
+    // the cartridge is only there so the bus can be built, the cpu never runs
+    Cartridge cart;
+    if(!cart.loadRom(argv[1])){
+        return 1;
+    }
+    Bus bus(cart);
+
+    // LCD off so VRAM and OAM can be written freely
+    bus.write(0xFF40, 0x00);
+    for(int address = 0x8000; address < 0x9800; ++address) bus.write(uint16_t(address), uint8_t(address * 37)); // tile data
+    for(int address = 0x9800; address < 0xA000; ++address) bus.write(uint16_t(address), uint8_t(address)); // tile maps
+
+    // 40 8x16 sprites only cover 64 lines, so keep one OAM image per 16 line band in WRAM
+    // and DMA the next one in as each band starts
+    constexpr int BAND_LINES = 16;
+    constexpr int BANDS = 144 / BAND_LINES;
+    for(int band = 0; band < BANDS; ++band){
+        for(int i = 0; i < 40; ++i){
+            uint16_t sprite = uint16_t(0xC000 + band * 0x100 + i * 4);
+            bus.write(sprite, uint8_t(16 + band * BAND_LINES)); // Y
+            bus.write(sprite + 1, uint8_t(8 + (i % 10) * 15 + band)); // X, spread over different tiles
+            bus.write(sprite + 2, uint8_t(i * 2)); // tile
+            bus.write(sprite + 3, uint8_t((i & 1) ? 0x30 : 0x80)); // flags
+        }
+    }
+
+    bus.write(0xFF42, 3); // SCY
+    bus.write(0xFF43, 5); // SCX
+    bus.write(0xFF4A, 72); // WY
+    bus.write(0xFF4B, 87); // WX
+    bus.write(0xFF40, 0xF7); // LCD, window, 8x16 objects and background on
+
+    constexpr int LINE = 456;
+    std::vector<uint32_t> output(160 * 144);
+    bus.ppu.setOutput(output.data(), format);
+    auto start = std::chrono::steady_clock::now();
+    for(int frame = 0; frame < frames; ++frame){
+        for(int band = 0; band < BANDS; ++band){
+            bus.write(0xFF46, uint8_t(0xC0 + band)); // catches the PPU up before the band's first OAM scan
+            bus.step(BAND_LINES * LINE);
+        }
+        bus.step(10 * LINE); // VBlank
+        bus.ppu.clearNewFrameFlag();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double lines = double(frames) * 144;
+    std::cout << frames << " frames in " << seconds << "s, "
+              << seconds * 1e9 / frames << " ns per frame, "
+              << seconds * 1e9 / lines << " ns per visible line\n";
+    return 0;
+}
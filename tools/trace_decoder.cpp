@@ -0,0 +1,72 @@
+#include "trace.h"
+#include "disassembler.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Turns a binary trace written with --trace=<file> into one line of text per instruction, skip or loss
+int main(int argc, char* argv[]){
+    if(argc < 2){
+        std::cerr << "Usage: " << argv[0] << " <trace-file> [--last=N]\n";
+        return 1;
+    }
+
+    uint64_t last = 0; // 0 = whole file
+    for(int i = 2; i < argc; ++i){
+        const std::string arg = argv[i];
+        if(arg.rfind("--last=", 0) == 0) last = std::strtoull(arg.c_str() + 7, nullptr, 10);
+    }
+
+    std::ifstream file(argv[1], std::ios::binary);
+    char magic[sizeof(TRACE_FILE_MAGIC)];
+    if(!file.read(magic, sizeof(magic)) || std::memcmp(magic, TRACE_FILE_MAGIC, sizeof(magic)) != 0){
+        std::cerr << "Not a trace file: " << argv[1] << "\n";
+        return 1;
+    }
+
+    TraceFileHeader header;
+    if(!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.capacity == 0){
+        std::cerr << "Truncated trace file: " << argv[1] << "\n";
+        return 1;
+    }
+
+    // the file is circular, once it wrapped the oldest entry kept sits right after the newest
+    uint64_t entries = std::min(header.written, header.capacity);
+    uint64_t oldest = header.written > header.capacity ? header.written % header.capacity : 0;
+    uint64_t first = (last != 0 && last < entries) ? entries - last : 0;
+    if(header.written > header.capacity){
+        std::printf("# %llu older entries were overwritten\n", static_cast<unsigned long long>(header.written - header.capacity));
+    }
+
+    TraceEntry entry;
+    for(uint64_t i = first; i < entries; ++i){
+        // entries are fixed size so only the jump back to slot 0 needs a seek
+        uint64_t slot = (oldest + i) % header.capacity;
+        if(i == first || slot == 0){
+            file.seekg(std::streamoff(sizeof(magic) + sizeof(header) + slot * sizeof(TraceEntry)));
+        }
+        if(!file.read(reinterpret_cast<char*>(&entry), sizeof(entry))) break;
+        if(entry.kind == TraceEntryKind::DROPPED){
+            std::printf("%12llu ---- %llu entries dropped, the writer fell behind\n",
+                        static_cast<unsigned long long>(entry.cycle), static_cast<unsigned long long>(entry.count()));
+            continue;
+        }
+        if(entry.kind == TraceEntryKind::SKIPPED){
+            std::printf("%12llu %04X  ---- %llu cycles skipped (halted or idle loop)\n",
+                        static_cast<unsigned long long>(entry.cycle), entry.PC, static_cast<unsigned long long>(entry.count()));
+            continue;
+        }
+        uint8_t bytes[3] = {entry.opcode, entry.operands[0], entry.operands[1]};
+        std::printf("%12llu %04X  %-18s AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X\n",
+                    static_cast<unsigned long long>(entry.cycle), entry.PC, disassemble(bytes, entry.PC).c_str(),
+                    entry.AF, entry.BC, entry.DE, entry.HL, entry.SP);
+    }
+
+    if(header.dropped > 0){
+        std::printf("# %llu entries dropped in total\n", static_cast<unsigned long long>(header.dropped));
+    }
+}